@@ -0,0 +1,249 @@
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <lib/environment.h>
+#include <lib/heap.h>
+#include <lib/interpreter.h>
+#include <lib/value.h>
+
+
+namespace {
+
+size_t allocation_count = 0;
+
+}  // namespace
+
+
+void* operator new(size_t size) {
+    ++allocation_count;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+
+namespace {
+
+double measure_ns(size_t iterations, const std::function<void()>& body) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+        body();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+void report(const std::string& name, double ns_per_op) {
+    std::cout << name << ": " << ns_per_op << " ns/op\n";
+}
+
+// A name that is assigned locally and never defined in an enclosing frame,
+// i.e. the first assignment of a local inside a fresh function scope.
+Binding make_local_binding() {
+    Binding binding("local");
+    binding.candidates_.push_back({0, 0});
+    binding.local_slot_ = 0;
+    return binding;
+}
+
+void bench_first_assignment() {
+    const size_t iterations = 200000;
+    auto global = Environment::create_global({});
+    Binding binding = make_local_binding();
+    Value value(1.0);
+
+    report("first assignment, assign + catch + declare", measure_ns(iterations, [&]() {
+        auto frame = Environment::create(global, 1);
+        try {
+            frame->assign(binding, value);
+        } catch (std::runtime_error&) {
+            frame->declare(binding.local_slot_, value);
+        }
+    }));
+
+    report("first assignment, assign_or_declare", measure_ns(iterations, [&]() {
+        auto frame = Environment::create(global, 1);
+        frame->assign_or_declare(binding, value);
+    }));
+}
+
+struct Workload {
+    std::string name_;
+    std::string code_;
+    size_t operations_;     // what one "op" is differs per workload, see the comments in workloads()
+};
+
+std::vector<Workload> workloads() {
+    return {
+        // One call of a function with a new local.
+        {"new local in a function called in a loop", R"(
+            f = function(x)
+                y = x + 1
+                return y
+            end function
+            i = 0
+            while i < 200000
+                f(i)
+                i += 1
+            end while
+        )", 200000},
+
+        // One call; fib(22) makes 57313 of them.
+        {"recursive calls", R"(
+            fib = function(n)
+                if n < 2 then
+                    return n
+                end if
+                return fib(n - 1) + fib(n - 2)
+            end function
+            fib(22)
+        )", 57313},
+
+        // One iteration of arithmetic on locals.
+        {"numeric loop", R"(
+            total = 0
+            i = 0
+            while i < 1000000
+                total += i * 3 % 7 - i / 2
+                i += 1
+            end while
+        )", 1000000},
+
+        // One appended piece, then one read of the whole string.
+        {"string building", R"(
+            s = ""
+            for i in range(100000)
+                s = s + to_string(i % 10) + ","
+            end for
+            n = len(s)
+        )", 100000},
+
+        // One push, one index and every 100th a slice.
+        {"list push, index and slice", R"(
+            l = []
+            for i in range(100000)
+                push(l, i * 2)
+            end for
+            total = 0
+            for i in range(100000)
+                total += l[i]
+                if i % 100 == 0 then
+                    total += len(l[i:i + 50])
+                end if
+            end for
+        )", 100000},
+
+        // One line split into fields, with the fields joined and edited.
+        {"string processing", R"(
+            line = "alpha-beta-gamma-delta,epsilon-zeta-eta-theta,iota-kappa-lambda-mu"
+            total = 0
+            i = 0
+            while i < 20000
+                fields = split(line, ",")
+                for f in fields
+                    total += len(f) + len(split(f, "-"))
+                end for
+                total += len(replace(join(fields, ";"), "-", "+")) + len(line)
+                i += 1
+            end while
+        )", 20000},
+
+        // One push plus two numeric stdlib calls.
+        {"stdlib calls", R"(
+            l = []
+            total = 0
+            i = 0
+            while i < 200000
+                push(l, i)
+                total += abs(len(l) - i)
+                i += 1
+            end while
+        )", 200000},
+
+        // One call of a one-line helper, inlined at -O1.
+        {"small helper calls", R"(
+            sq = function(x) return x * x + 1 end function
+            total = 0
+            for i in range(200000)
+                total += sq(i % 100)
+            end for
+        )", 200000},
+
+        // One closure created and called.
+        {"closure creation", R"(
+            make_adder = function(n)
+                return function(x)
+                    return x + n
+                end function
+            end function
+            total = 0
+            for i in range(100000)
+                add = make_adder(i)
+                total += add(1)
+            end for
+        )", 100000},
+    };
+}
+
+// The best of kRuns runs, so that a single slow run does not hide or fake a regression.
+void bench_script(const Workload& workload, bool tree_walk) {
+    constexpr int kRuns = 3;
+    InterpreterOptions options;
+    options.tree_walk_ = tree_walk;
+    double best_ns = 0;
+    size_t allocations = 0;
+    size_t objects = 0;
+    for (int run = 0; run < kRuns; ++run) {
+        std::ostringstream output;
+        std::istringstream input(workload.code_);
+        size_t allocations_before = allocation_count;
+        size_t objects_before = CycleCollector::stats().allocations_;
+        auto start = std::chrono::steady_clock::now();
+        if (!interpret(input, output, options)) {
+            std::cout << workload.name_ << ": failed: " << output.str() << "\n";
+            return;
+        }
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        if (run == 0 || ns < best_ns)
+            best_ns = ns;
+        allocations = allocation_count - allocations_before;
+        objects = CycleCollector::stats().allocations_ - objects_before;
+    }
+    double ops = static_cast<double>(workload.operations_);
+    std::cout << workload.name_ << (tree_walk ? " (tree walk)" : " (vm)") << ": "
+              << best_ns / ops << " ns/op, "
+              << static_cast<double>(allocations) / ops << " allocs/op, "
+              << static_cast<double>(objects) / ops << " heap objects/op\n";
+}
+
+}  // namespace
+
+
+// itmoscript_bench [filter] runs the benchmarks whose names contain filter.
+int main(int argc, char** argv) {
+    std::string filter = argc > 1 ? argv[1] : "";
+
+    if (std::string("first assignment").find(filter) != std::string::npos)
+        bench_first_assignment();
+
+    for (const Workload& workload : workloads()) {
+        if (workload.name_.find(filter) == std::string::npos)
+            continue;
+        bench_script(workload, false);
+        bench_script(workload, true);
+    }
+}
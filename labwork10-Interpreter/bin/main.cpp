@@ -1,13 +1,85 @@
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <string>
 #include "interpreter.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+void print_heap_stats(std::ostream& out) {
+    const HeapStats& stats = CycleCollector::stats();
+    out << "heap: peak " << stats.peak_objects_ << " objects, " << stats.objects_ << " live after exit, "
+        << stats.collections_ << " collections freed " << stats.collected_ << " objects\n";
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    out << "peak RSS: " << usage.ru_maxrss / 1024 << " KB\n";
+#else
+    out << "peak RSS: " << usage.ru_maxrss << " KB\n";
+#endif
+#endif
+}
+
+}  // namespace
+
 int main(int argc, char** argv) {
-    if (argc < 2) {
+    // Script input and output are buffered by the interpreter; unsynced streams read and
+    // write whole blocks instead of going through stdio one character at a time.
+    std::ios::sync_with_stdio(false);
+    InterpreterOptions options;
+    const char* filename = nullptr;
+    bool heap_stats = false;
+    std::optional<std::string> profile_path;     // folded stacks; the report goes to stderr
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--tree-walk") {
+            options.tree_walk_ = true;
+        } else if (arg == "--no-cache") {
+            options.use_cache_ = false;
+        } else if (arg == "-O0" || arg == "-O1") {
+            options.optimization_level_ = arg[2] - '0';
+        } else if (arg.starts_with("--gc-threshold=")) {
+            options.gc_threshold_ = std::stoul(arg.substr(arg.find('=') + 1));
+        } else if (arg.starts_with("--max-stack-mb=")) {
+            options.max_stack_bytes_ = std::stoul(arg.substr(arg.find('=') + 1)) << 20;
+        } else if (arg == "--profile") {
+            profile_path = "";
+        } else if (arg.starts_with("--profile=")) {
+            profile_path = arg.substr(arg.find('=') + 1);
+        } else if (arg == "--heap-stats") {
+            heap_stats = true;
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if (!filename) {
         std::cerr << "The file name was expected\n";
         return 1;
     }
 
-    if (!interpret_file(argv[1], std::cout)) {
+    Profiler profiler;
+    if (profile_path)
+        options.profiler_ = &profiler;
+
+    bool ok = interpret_file(filename, std::cout, options);
+    if (heap_stats)
+        print_heap_stats(std::cerr);
+    if (profile_path) {
+        if (profile_path->empty())
+            *profile_path = std::string(filename) + ".folded";
+        profiler.report(std::cerr);
+        std::ofstream folded(*profile_path);
+        profiler.write_folded(folded);
+        if (!folded)
+            std::cerr << "cannot write " << *profile_path << "\n";
+    }
+    if (!ok) {
         std::cerr << "Interpretation failed\n";
         return 1;
     }
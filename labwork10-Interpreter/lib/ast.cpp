@@ -1,12 +1,29 @@
 #include "environment.h"
 #include "value.h"
 #include "ast.h"  
+#include <array>
+#include <cmath>
 
 
-NumberNode::NumberNode(double x) : value_(x) {}
+void* ASTArena::allocate(size_t size, size_t alignment) {
+    size_t offset = (used_ + alignment - 1) & ~(alignment - 1);
+    if (blocks_.empty() || offset + size > kBlockSize) {
+        blocks_.push_back(std::make_unique<std::byte[]>(kBlockSize));
+        offset = 0;
+    }
+    used_ = offset + size;
+    return blocks_.back().get() + offset;
+}
+
+
+NumberNode::NumberNode(double x) : value_(Value::make_number(x)) {}
 
 Value NumberNode::execute(ExecutionArgs& ex_args) {
-    return Value(value_);
+    return value_;
+}
+
+std::optional<Value> NumberNode::constant() const {
+    return value_;
 }
 
 
@@ -16,6 +33,10 @@ Value NilNode::execute(ExecutionArgs& ex_args) {
     return Value();
 }
 
+std::optional<Value> NilNode::constant() const {
+    return Value();
+}
+
 
 StringNode::StringNode(std::string value) : value_(std::move(value)) {}
 
@@ -23,28 +44,92 @@ Value StringNode::execute(ExecutionArgs& ex_args) {
     return Value(value_);
 }
 
+std::optional<Value> StringNode::constant() const {
+    return Value(value_);
+}
+
+
+ConstantNode::ConstantNode(Value value) : value_(std::move(value)) {}
+
+Value ConstantNode::execute(ExecutionArgs& ex_args) {
+    return value_;
+}
+
+std::optional<Value> ConstantNode::constant() const {
+    return value_;
+}
+
 
 AssignmentNode::AssignmentNode(std::string name, ASTPtr expr)
-    : name_(std::move(name)), expr_(std::move(expr)) {}
+    : binding_(std::move(name)), expr_(std::move(expr)) {}
 
 Value AssignmentNode::execute(ExecutionArgs& ex_args) {
     Value value = expr_->execute(ex_args);
-    try {
-        ex_args.env_->assign(name_, value);
-    } catch (std::runtime_error&) {
-        ex_args.env_->declare(name_, value);
-    }
+    ex_args.env_->assign_or_declare(binding_, value);
     return value;
 }
 
 
+IncrementNode::IncrementNode(std::string name, TokenType op, Value step)
+    : binding_(std::move(name)), op_(op), step_(std::move(step)) {}
+
+Value IncrementNode::execute(ExecutionArgs& ex_args) {
+    Value* target = ex_args.env_->find(binding_);
+    if (!target)
+        throw std::runtime_error("undefined variable: " + binding_.name_);
+    if (op_ == TokenType::plus_)
+        *target += step_;
+    else
+        *target -= step_;
+    return *target;
+}
+
+
 BinaryOpNode::BinaryOpNode(TokenType op, ASTPtr left, ASTPtr right)
-    : op_(op), left_(std::move(left)), right_(std::move(right)) {}
+    : op_(op), left_(std::move(left)), right_(std::move(right)),
+      handler_(&BinaryOpNode::generic), number_handler_(find_number_handler(op)) {}
 
 Value BinaryOpNode::execute(ExecutionArgs& ex_args) {
     Value lhs = left_->execute(ex_args);
     Value rhs = right_->execute(ex_args);
-    switch (op_) {
+    return handler_(*this, lhs, rhs);
+}
+
+Value BinaryOpNode::generic(BinaryOpNode& node, const Value& lhs, const Value& rhs) {
+    if (node.number_handler_ && lhs.type() == ValueType::number && rhs.type() == ValueType::number)
+        node.handler_ = node.number_handler_;
+    return apply(node.op_, lhs, rhs);
+}
+
+template <auto Op>
+Value BinaryOpNode::numbers(BinaryOpNode& node, const Value& lhs, const Value& rhs) {
+    if (lhs.type() != ValueType::number || rhs.type() != ValueType::number) {
+        node.handler_ = &BinaryOpNode::generic;
+        return apply(node.op_, lhs, rhs);
+    }
+    return Op(lhs, rhs);
+}
+
+BinaryOpNode::Handler BinaryOpNode::find_number_handler(TokenType op) {
+    switch (op) {
+        case TokenType::plus_: return &numbers<&Value::add_numbers>;
+        case TokenType::minus_: return &numbers<&Value::sub_numbers>;
+        case TokenType::mul_: return &numbers<&Value::mul_numbers>;
+        case TokenType::div_: return &numbers<&Value::div_numbers>;
+        case TokenType::percent_: return &numbers<&Value::mod_numbers>;
+        case TokenType::equal_: return &numbers<[](const Value& l, const Value& r) { return Value(l.as_number() == r.as_number()); }>;
+        case TokenType::not_equal_: return &numbers<[](const Value& l, const Value& r) { return Value(l.as_number() != r.as_number()); }>;
+        case TokenType::less_: return &numbers<[](const Value& l, const Value& r) { return Value(l.as_number() < r.as_number()); }>;
+        case TokenType::less_equal_: return &numbers<[](const Value& l, const Value& r) { return Value(l.as_number() <= r.as_number()); }>;
+        case TokenType::greater_: return &numbers<[](const Value& l, const Value& r) { return Value(l.as_number() > r.as_number()); }>;
+        case TokenType::greater_equal_: return &numbers<[](const Value& l, const Value& r) { return Value(l.as_number() >= r.as_number()); }>;
+        default:
+            return nullptr;
+    }
+}
+
+Value BinaryOpNode::apply(TokenType op, const Value& lhs, const Value& rhs) {
+    switch (op) {
         case TokenType::plus_: return lhs + rhs;
         case TokenType::minus_: return lhs - rhs;
         case TokenType::mul_: return lhs * rhs;
@@ -57,38 +142,51 @@ Value BinaryOpNode::execute(ExecutionArgs& ex_args) {
         case TokenType::less_equal_: return lhs <= rhs;
         case TokenType::greater_: return lhs > rhs;
         case TokenType::greater_equal_: return lhs >= rhs;
-        case TokenType::and_: return lhs.logic_and(rhs);
-        case TokenType::or_: return lhs.logic_or(rhs);
         default:
-            throw std::runtime_error("unsupported binary operator " + op_);
+            throw std::runtime_error("unsupported binary operator " + op);
     }
 }
 
 
+LogicalOpNode::LogicalOpNode(TokenType op, ASTPtr left, ASTPtr right)
+    : op_(op), left_(std::move(left)), right_(std::move(right)) {}
+
+Value LogicalOpNode::execute(ExecutionArgs& ex_args) {
+    bool lhs = left_->execute(ex_args).to_bool();
+    if (lhs == (op_ == TokenType::or_))
+        return Value(lhs);
+    return Value(right_->execute(ex_args).to_bool());
+}
+
+
 UnaryOpNode::UnaryOpNode(TokenType op, ASTPtr obj)
     : op_(op), obj_(std::move(obj)) {}
 
 Value UnaryOpNode::execute(ExecutionArgs& ex_args) {
-    Value value = obj_->execute(ex_args);
-    switch (op_) {
+    return apply(op_, obj_->execute(ex_args));
+}
+
+Value UnaryOpNode::apply(TokenType op, const Value& value) {
+    switch (op) {
         case TokenType::plus_: return value;
         case TokenType::minus_: {
-            double x = std::get<double>(value.get_data());
-            return Value(-x);
+            if (value.type() != ValueType::number)
+                throw std::runtime_error("invalid type (unary '-')");
+            return value.negate();
         }
         case TokenType::not_: return value.logic_not();
         default:
-            throw std::runtime_error("unsupported binary operator " + op_);
+            throw std::runtime_error("unsupported binary operator " + op);
     }
 
 }
 
 
 VariableNode::VariableNode(std::string name)
-    : name_(std::move(name)) {}
+    : binding_(std::move(name)) {}
 
 Value VariableNode::execute(ExecutionArgs& ex_args) {
-    return ex_args.env_->get(name_);
+    return ex_args.env_->get(binding_);
 }
 
 
@@ -97,13 +195,7 @@ IfNode::IfNode(ASTPtr cond, ASTPtr then_b, ASTPtr els_b)
 
 Value IfNode::execute(ExecutionArgs& ex_args) {
     Value cond = condition_->execute(ex_args);
-    bool is_cond_true = false;
-    if (cond.type() == ValueType::boolean) {
-        is_cond_true = std::get<bool>(cond.get_data()) ;
-    } else if (cond.type() == ValueType::number) {
-        is_cond_true = (std::get<double>(cond.get_data()) != 0.0);
-    }
-    if (is_cond_true) {
+    if (cond.is_true()) {
         return then_block_->execute(ex_args);
     }
     if (else_block_) {
@@ -113,12 +205,13 @@ Value IfNode::execute(ExecutionArgs& ex_args) {
 }
 
 
-FunctionNode::FunctionNode(std::vector<std::string> params, ASTPtr body)
-    : params_(std::move(params)), body_(std::move(body)) {}
+FunctionNode::FunctionNode(std::vector<std::string> params, ASTPtr body, const FunctionInfo& info)
+    : params_(std::move(params)), body_(std::move(body)), info_(info) {}
 
 Value FunctionNode::execute(ExecutionArgs& ex_args) {
-    auto func_env = Environment::create_child(ex_args.env_);
-    return Value(std::make_shared<FunctionObject>(params_, std::move(body_), func_env));
+    auto function = make_ref<FunctionObject>(params_.size(), frame_, body_.get(), Ref<Environment>(ex_args.env_));
+    function->info_ = &info_;
+    return Value(function);
 }
 
 
@@ -137,6 +230,8 @@ BlockNode::BlockNode(std::vector<ASTPtr> commands) : commands_(std::move(command
 Value BlockNode::execute(ExecutionArgs& ex_args) {
     Value last;
     for (auto& com : commands_) {
+        if (ex_args.profiler_)
+            ex_args.profiler_->line(com->line_);
         last = com->execute(ex_args);
         if(ex_args.is_returning_) {
             return ex_args.return_value_;
@@ -154,34 +249,77 @@ PrintNode::PrintNode(ASTPtr expr, bool is_ln = false) : expr_(std::move(expr)),
 Value PrintNode::execute(ExecutionArgs& ex_args) {
     Value result = expr_->execute(ex_args); 
     if (is_ln_)
-        ex_args.output_ << result.to_string() << "\n"; 
-    else 
-        ex_args.output_ << result.to_string();
+        ex_args.output_.println(result);
+    else
+        ex_args.output_.print(result);
     return result;
 }
 
 
+namespace {
+
+Value call_with_arguments(const Value& func_val, std::vector<ASTPtr>& arguments, ExecutionArgs& ex_args) {
+    // Arguments of the usual short calls stay on the native stack.
+    constexpr size_t kInlineArgs = 8;
+    std::array<Value, kInlineArgs> inline_args;
+    std::vector<Value> heap_args;
+    Value* args = inline_args.data();
+    if (arguments.size() > kInlineArgs) {
+        heap_args.resize(arguments.size());
+        args = heap_args.data();
+    }
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        args[i] = arguments[i]->execute(ex_args);
+    }
+
+    return func_val.call(std::span<const Value>(args, arguments.size()), ex_args);
+}
+
+}  // namespace
+
+
 CallNode::CallNode(ASTPtr func, std::vector<ASTPtr> args) : function_(std::move(func)), arguments_(std::move(args)) {}
 
 Value CallNode::execute(ExecutionArgs& ex_args) {
     Value func_val = function_->execute(ex_args);
+    return call_with_arguments(func_val, arguments_, ex_args);
+}
 
-    std::vector<Value> realArgs;
-    for (auto& arg : arguments_) {
-        realArgs.push_back(arg->execute(ex_args));
-    }
 
-    return func_val.call(realArgs, ex_args);
+InlineCallNode::InlineCallNode(ASTPtr func, std::vector<ASTPtr> args, uint32_t function_id,
+                               std::vector<std::string> params, ASTPtr body)
+    : function_(std::move(func)), arguments_(std::move(args)), function_id_(function_id),
+      params_(params.begin(), params.end()), body_(std::move(body)) {}
+
+Value InlineCallNode::execute(ExecutionArgs& ex_args) {
+    Value func_val = function_->execute(ex_args);
+    if (func_val.type() != ValueType::function || !func_val.as_function().info_ ||
+        func_val.as_function().info_->id_ != function_id_)
+        return call_with_arguments(func_val, arguments_, ex_args);
+    for (size_t i = 0; i < arguments_.size(); ++i)
+        ex_args.env_->declare(params_[i].local_slot_, arguments_[i]->execute(ex_args));
+    Value result = body_->execute(ex_args);
+    // Like the frame of a real call, the parameters do not outlive it.
+    for (const auto& param : params_)
+        ex_args.env_->declare(param.local_slot_, Value());
+    return result;
 }
 
 
 WhileNode::WhileNode(ASTPtr cond, ASTPtr body) : condition_(std::move(cond)), body_(std::move(body)) {}
 
 Value WhileNode::execute(ExecutionArgs& ex_args) {
-    while (std::get<bool>(condition_->execute(ex_args).get_data())) {
+    while (true) {
+        if (ex_args.profiler_)
+            ex_args.profiler_->line(line_);
+        if (!condition_->execute(ex_args).is_true())
+            break;
         ex_args.is_continuing_ = false;
         ex_args.is_breaking_ = false;
         body_->execute(ex_args);
+        if (ex_args.is_returning_) {
+            break;
+        }
         if (ex_args.is_breaking_) {
             ex_args.is_breaking_ = false;
             break;
@@ -196,20 +334,35 @@ Value WhileNode::execute(ExecutionArgs& ex_args) {
 
 
 ForNode::ForNode(std::string var_name, ASTPtr range, ASTPtr body)
-    : var_name_(std::move(var_name)), range_(std::move(range)), body_(std::move(body)) {}
+    : var_binding_(std::move(var_name)), range_(std::move(range)), body_(std::move(body)) {}
 
 Value ForNode::execute(ExecutionArgs& ex_args) {
     auto range = range_->execute(ex_args);
-    auto range_list = std::get<List>(range.get_data());
-    for (const Value& i : *range_list) {
-        try {
-            ex_args.env_->assign(var_name_, Value(i));
-        } catch (...) {
-            ex_args.env_->declare(var_name_, Value(i));
+    if (range.type() != ValueType::list && range.type() != ValueType::lines)
+        throw std::runtime_error("for loop expects a list");
+    // Null for lines(), which are read one per iteration.
+    const ListObject* range_list = range.type() == ValueType::list ? &range.as_list() : nullptr;
+    std::string line;
+    for (size_t idx = 0;; ++idx) {
+        if (ex_args.profiler_)
+            ex_args.profiler_->line(line_);
+        Value i;
+        if (range_list) {
+            if (idx >= range_list->size())
+                break;
+            i = range_list->at(idx);
+        } else {
+            if (!ex_args.input_.read_line(line))
+                break;
+            i = Value(std::move(line));
         }
+        ex_args.env_->assign_or_declare(var_binding_, i);
         ex_args.is_continuing_ = false;
         ex_args.is_breaking_ = false;     
         body_->execute(ex_args);
+        if (ex_args.is_returning_) {
+            break;
+        }
         if (ex_args.is_breaking_) {
             ex_args.is_breaking_ = false;
             break;
@@ -238,11 +391,24 @@ Value ContinueNode::execute(ExecutionArgs& ex_args) {
 ListNode::ListNode(std::vector<ASTPtr> elems) : elements_(std::move(elems)) {}
 
 Value ListNode::execute(ExecutionArgs& ex_args) {
-    auto result = std::make_shared<std::vector<Value>>();
+    std::vector<Value> items;
+    items.reserve(elements_.size());
     for (auto& element : elements_) {
-        result->push_back(element->execute(ex_args));
+        items.push_back(element->execute(ex_args));
+    }
+    return Value(make_ref<ListObject>(std::move(items)));
+}
+
+
+DictNode::DictNode(std::vector<std::pair<ASTPtr, ASTPtr>> entries) : entries_(std::move(entries)) {}
+
+Value DictNode::execute(ExecutionArgs& ex_args) {
+    auto dict = make_ref<DictObject>();
+    for (auto& [key, value] : entries_) {
+        Value k = key->execute(ex_args);
+        dict->set(k, value->execute(ex_args));
     }
-    return Value(result);
+    return Value(dict);
 }
 
 
@@ -254,14 +420,13 @@ Value IndexNode::execute(ExecutionArgs& ex_args) {
     if (!idx_ && !end_idx_) {
         return target.slice(0, std::numeric_limits<int>::max());
     } else if (!idx_) {
-        int j = static_cast<int>(std::get<double>(end_idx_->execute(ex_args).get_data()));
+        int j = end_idx_->execute(ex_args).to_index();
         return target.slice(0, j);
     } else if (!end_idx_) {
-        int i = static_cast<int>(std::get<double>(idx_->execute(ex_args).get_data()));
-        return target.index(i);
+        return target.index(idx_->execute(ex_args));
     } else {
-        int i = static_cast<int>(std::get<double>(idx_->execute(ex_args).get_data()));
-        int j = static_cast<int>(std::get<double>(end_idx_->execute(ex_args).get_data()));
+        int i = idx_->execute(ex_args).to_index();
+        int j = end_idx_->execute(ex_args).to_index();
         return target.slice(i, j);
     }
 }
\ No newline at end of file
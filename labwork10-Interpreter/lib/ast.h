@@ -3,45 +3,117 @@
 #include <vector>
 #include <string>
 #include <limits>
+#include <optional>
+#include <cstddef>
+#include <new>
 #include "value.h"
+#include "input_buffer.h"
 #include "lexer.h"
 #include "environment.h"
+#include "profiler.h"
 
 
 class Environment;
+class Compiler;
+class Resolver;
+class Optimizer;
+class ASTNode;
+class VirtualMachine;
+
+// Nodes live in an ASTArena: deleting a node only runs its destructor.
+struct ASTDeleter {
+    void operator()(ASTNode* node) const;
+};
+
+using ASTPtr = std::unique_ptr<ASTNode, ASTDeleter>;
+
+// Owns the memory of every node of a program. Nodes are bump-allocated in large blocks
+// and the blocks are released together when the arena is destroyed, so it must outlive
+// the tree and every function value that refers to its nodes.
+class ASTArena {
+public:
+    ASTArena() = default;
+    ASTArena(const ASTArena&) = delete;
+    ASTArena& operator=(const ASTArena&) = delete;
+
+    template <typename T, typename... Args>
+    ASTPtr make(Args&&... args) {
+        void* memory = allocate(sizeof(T), alignof(T));
+        return ASTPtr(new (memory) T(std::forward<Args>(args)...));
+    }
+
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    size_t used_ = kBlockSize;
+
+    void* allocate(size_t size, size_t alignment);
+};
 
 struct ExecutionArgs {
-    std::shared_ptr<Environment> env_;
-    std::ostream& output_;
-    std::istream& input_;
+    Environment* env_;
+    FrameArena& arena_;
+    OutputBuffer& output_;
+    InputBuffer& input_;
     bool is_returning_;
     Value return_value_;
     bool is_breaking_;
     bool is_continuing_;
+    // The VM running the program, if any: compiled functions called from native code run on it.
+    VirtualMachine* vm_ = nullptr;
+    // Attached with --profile; the engines report lines, calls and returns to it.
+    Profiler* profiler_ = nullptr;
+    // The lowest native stack address a script call that recurses natively may start at, 0 for no limit:
+    // every call of the tree walker, and the VM's calls from native code.
+    uintptr_t stack_limit_ = 0;
 
-    ExecutionArgs(std::shared_ptr<Environment> env, std::ostream& out, std::istream& in)
-        : env_(std::move(env)), output_(out), input_(in), is_returning_(false), is_breaking_(false), is_continuing_(false) {}
+    ExecutionArgs(Environment* env, FrameArena& arena, OutputBuffer& out, InputBuffer& in)
+        : env_(env), arena_(arena), output_(out), input_(in), is_returning_(false), is_breaking_(false), is_continuing_(false) {}
 };
 
 class ASTNode {
 public:
+    uint32_t line_ = 0;     // source line of a statement, 0 for nodes inside an expression
+
     virtual ~ASTNode() = default;
     virtual Value execute(ExecutionArgs& ex_args) = 0; 
+    virtual void compile(Compiler& compiler) = 0;
+    virtual void compile_statement(Compiler& compiler, bool is_tail);
+    virtual void resolve(Resolver& resolver) = 0;
+    // Optimizes the children and returns a replacement for this node, or nullptr to keep it.
+    virtual ASTPtr optimize(Optimizer& optimizer) = 0;
+    // The value of a node that evaluates to a compile-time constant.
+    virtual std::optional<Value> constant() const { return std::nullopt; }
+    // A copy of the node for Optimizer::inline_call, or nullptr if it cannot be inlined.
+    virtual ASTPtr inline_copy(Optimizer& optimizer) const { return nullptr; }
 };
 
-using ASTPtr = std::unique_ptr<ASTNode>;
+inline void ASTDeleter::operator()(ASTNode* node) const {
+    node->~ASTNode();
+}
 
 class NumberNode : public ASTNode {
-    double value_;
+    Value value_;       // integer literals in the integer form
 public:
     NumberNode(double x);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    std::optional<Value> constant() const override;
+    ASTPtr inline_copy(Optimizer& optimizer) const override;
 };
 
 class NilNode : public ASTNode {
 public:
     NilNode();
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    std::optional<Value> constant() const override;
+    ASTPtr inline_copy(Optimizer& optimizer) const override;
 };
 
 class StringNode : public ASTNode {
@@ -49,23 +121,91 @@ class StringNode : public ASTNode {
 public:   
     StringNode(std::string value);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    std::optional<Value> constant() const override;
+    ASTPtr inline_copy(Optimizer& optimizer) const override;
+};
+
+// A value folded by Optimizer.
+class ConstantNode : public ASTNode {
+    Value value_;
+public:
+    ConstantNode(Value value);
+    Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    std::optional<Value> constant() const override;
+    ASTPtr inline_copy(Optimizer& optimizer) const override;
 };
 
 class AssignmentNode : public ASTNode {
-    std::string name_;
+    Binding binding_;
     ASTPtr expr_;
 public:
     AssignmentNode(std::string name, ASTPtr expr);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    void compile_statement(Compiler& compiler, bool is_tail) override;
+};
+
+// `x += c` and `x -= c` with a constant c, rewritten by Optimizer to update x in place.
+class IncrementNode : public ASTNode {
+    Binding binding_;
+    TokenType op_;
+    Value step_;
+public:
+    IncrementNode(std::string name, TokenType op, Value step);
+    Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
 };
 
 class BinaryOpNode : public ASTNode {
+    using Handler = Value (*)(BinaryOpNode& node, const Value& lhs, const Value& rhs);
+
     TokenType op_;
     ASTPtr left_;
     ASTPtr right_;
+    // Inline cache of the operand types: the node starts on the generic path, switches to
+    // number_handler_ once both operands are numbers and back on the first other type.
+    Handler handler_;
+    Handler number_handler_;
+
+    static Value generic(BinaryOpNode& node, const Value& lhs, const Value& rhs);
+    template <auto Op>
+    static Value numbers(BinaryOpNode& node, const Value& lhs, const Value& rhs);
+    static Handler find_number_handler(TokenType op);
 public:
     BinaryOpNode(TokenType op, ASTPtr l, ASTPtr r);
+    static Value apply(TokenType op, const Value& lhs, const Value& rhs);
+    TokenType op() const { return op_; }
+    const ASTNode& left() const { return *left_; }
+    const ASTNode& right() const { return *right_; }
+    Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    ASTPtr inline_copy(Optimizer& optimizer) const override;
+};
+
+// `and` / `or`: the right operand is evaluated only when the left one does not decide the result.
+class LogicalOpNode : public ASTNode {
+    TokenType op_;
+    ASTPtr left_;
+    ASTPtr right_;
+public:
+    LogicalOpNode(TokenType op, ASTPtr l, ASTPtr r);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    ASTPtr inline_copy(Optimizer& optimizer) const override;
 };
 
 class UnaryOpNode : public ASTNode {
@@ -73,14 +213,24 @@ class UnaryOpNode : public ASTNode {
     ASTPtr obj_;
 public:
     UnaryOpNode (TokenType op, ASTPtr obj);
+    static Value apply(TokenType op, const Value& value);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    ASTPtr inline_copy(Optimizer& optimizer) const override;
 };
 
 class VariableNode : public ASTNode {
-    std::string name_;
+    Binding binding_;
 public:
     VariableNode(std::string name);
+    const std::string& name() const { return binding_.name_; }
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    ASTPtr inline_copy(Optimizer& optimizer) const override;
 };
 
 class IfNode : public ASTNode {
@@ -90,28 +240,52 @@ class IfNode : public ASTNode {
 public:
     IfNode(ASTPtr cond, ASTPtr then, ASTPtr els);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    void compile_statement(Compiler& compiler, bool is_tail) override;
 };
 
 class FunctionNode : public ASTNode {
     std::vector<std::string> params_;
     ASTPtr body_;
+    FrameLayout frame_;
+    FunctionInfo info_;
 public:
-    FunctionNode(std::vector<std::string> params, ASTPtr body);
+    FunctionNode(std::vector<std::string> params, ASTPtr body, const FunctionInfo& info);
+    void set_name(std::string name) { info_.name_ = std::move(name); }
+    const std::vector<std::string>& params() const { return params_; }
+    const FunctionInfo& info() const { return info_; }
+    // The expression that makes up the whole body, as in `return x * x`, or nullptr.
+    const ASTNode* single_expression() const;
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
 };
 
 class ReturnNode : public ASTNode {
     ASTPtr expr_;
 public:
     ReturnNode(ASTPtr expr);
+    const ASTNode& expr() const { return *expr_; }
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    void compile_statement(Compiler& compiler, bool is_tail) override;
 };
 
 class BlockNode : public ASTNode {
     std::vector<ASTPtr> commands_;
 public:
     BlockNode(std::vector<ASTPtr> commands);
+    const std::vector<ASTPtr>& commands() const { return commands_; }
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    void compile_statement(Compiler& compiler, bool is_tail) override;
 };
 
 class PrintNode : public ASTNode {
@@ -120,6 +294,10 @@ class PrintNode : public ASTNode {
 public:
     PrintNode(ASTPtr expr, bool is_ln);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    void compile_statement(Compiler& compiler, bool is_tail) override;
 };
 
 class CallNode : public ASTNode {
@@ -128,6 +306,28 @@ class CallNode : public ASTNode {
 public:
     CallNode(ASTPtr func, std::vector<ASTPtr> args);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    void compile_statement(Compiler& compiler, bool is_tail) override;
+};
+
+// A call of a small function inlined by Optimizer. While the callee is still the function
+// literal with id function_id_, the arguments are stored in hidden variables params_ of
+// the calling scope and the copied body is evaluated in place; otherwise it is an ordinary call.
+class InlineCallNode : public ASTNode {
+    ASTPtr function_;
+    std::vector<ASTPtr> arguments_;
+    uint32_t function_id_;
+    std::vector<Binding> params_;
+    ASTPtr body_;
+public:
+    InlineCallNode(ASTPtr func, std::vector<ASTPtr> args, uint32_t function_id, std::vector<std::string> params,
+                   ASTPtr body);
+    Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
 };
 
 class WhileNode : public ASTNode {
@@ -136,25 +336,41 @@ class WhileNode : public ASTNode {
 public:
     WhileNode(ASTPtr cond, ASTPtr bod);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    void compile_statement(Compiler& compiler, bool is_tail) override;
 };
 
 class ContinueNode : public ASTNode {
 public:
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    void compile_statement(Compiler& compiler, bool is_tail) override;
 };
 
 class ForNode : public ASTNode {
-    std::string var_name_;
+    Binding var_binding_;
     ASTPtr range_;
     ASTPtr body_;
 public:
     ForNode(std::string var_name, ASTPtr range, ASTPtr body);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    void compile_statement(Compiler& compiler, bool is_tail) override;
 };
 
 class BreakNode : public ASTNode {
 public:
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    void compile_statement(Compiler& compiler, bool is_tail) override;
 };
 
 class ListNode: public ASTNode {
@@ -162,6 +378,19 @@ class ListNode: public ASTNode {
 public:
     ListNode(std::vector<ASTPtr> elements);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+};
+
+class DictNode: public ASTNode {
+    std::vector<std::pair<ASTPtr, ASTPtr>> entries_;
+public:
+    DictNode(std::vector<std::pair<ASTPtr, ASTPtr>> entries);
+    Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
 };
 
 class IndexNode: public ASTNode {
@@ -171,4 +400,8 @@ class IndexNode: public ASTNode {
 public:
     IndexNode(ASTPtr tgt, ASTPtr idx, ASTPtr end);
     Value execute(ExecutionArgs& ex_args) override;
+    void compile(Compiler& compiler) override;
+    void resolve(Resolver& resolver) override;
+    ASTPtr optimize(Optimizer& optimizer) override;
+    ASTPtr inline_copy(Optimizer& optimizer) const override;
 };
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "value.h"
+#include "environment.h"
+#include "profiler.h"
+
+
+enum class OpCode : uint8_t {
+    constant,        // push constants_[arg]
+    nil,             // push nil
+    pop,             // drop the top of the stack
+    dup,             // duplicate the top of the stack
+    get_var,         // push the variable bound by bindings_[arg]
+    set_var,         // pop and assign-or-declare the variable bound by bindings_[arg]
+    increment,       // step -> variable bindings_[arg] += step, in place
+    decrement,       // step -> variable bindings_[arg] -= step, in place
+
+    // The VM rewrites these in place into their *_number forms once both operands are numbers.
+    add,
+    sub,
+    mul,
+    div,
+    mod,
+    pow,
+    equal,
+    not_equal,
+    less,
+    less_equal,
+    greater,
+    greater_equal,
+    negate,
+    logic_not,
+    to_bool,         // value -> its truth value
+
+    // Number-only forms, rewritten back to the generic opcode when an operand is not a number.
+    add_number,
+    sub_number,
+    mul_number,
+    div_number,
+    mod_number,
+    equal_number,
+    not_equal_number,
+    less_number,
+    less_equal_number,
+    greater_number,
+    greater_equal_number,
+
+    jump,            // ip = arg
+    jump_if_false,   // pop the condition, ip = arg if it does not hold
+    and_jump,        // if the top is false replace it with false and ip = arg, otherwise pop it
+    or_jump,         // if the top is true replace it with true and ip = arg, otherwise pop it
+
+    make_list,       // pop arg elements into a new list
+    make_dict,       // pop arg key-value pairs into a new dictionary
+    index,           // target idx -> target[idx]
+    slice,           // arg: 0 = target[i:j], 1 = target[:j], 2 = target[:]
+    make_function,   // push a closure over functions_[arg]
+    call,            // callee arg_1 ... arg_n -> result, arg = n
+    tail_call,       // call followed by return_value; replaces the current frame when the callee is
+                     // a script function, so tail recursion runs in constant space
+    inline_guard,    // if the top is the function literal with id arg, pop it and skip the next instruction
+
+    print,           // pop and print
+    println,         // pop and print with a new line
+
+    for_prep,        // list -> list 0
+    for_next,        // list i -> list i+1 list[i], or ip = arg when exhausted; lines() gives the next input line
+
+    return_value     // pop and return from the current function
+};
+
+// Instructions are 32-bit words: opcode in the low byte, operand in the upper 24 bits.
+using Instruction = uint32_t;
+
+constexpr uint32_t kMaxOperand = (1u << 24) - 1;
+
+inline Instruction make_instruction(OpCode op, uint32_t arg = 0) {
+    return static_cast<uint32_t>(op) | (arg << 8);
+}
+
+inline OpCode get_opcode(Instruction ins) {
+    return static_cast<OpCode>(ins & 0xFF);
+}
+
+inline uint32_t get_operand(Instruction ins) {
+    return ins >> 8;
+}
+
+
+struct FunctionPrototype {
+    size_t arity_ = 0;
+    FrameLayout frame_;
+    mutable std::vector<Instruction> code_;     // specialized by the VM while it runs
+    std::vector<uint32_t> lines_;               // source line of each instruction, for the profiler
+    std::vector<Value> constants_;
+    std::vector<Binding> bindings_;
+    std::vector<std::unique_ptr<FunctionPrototype>> functions_;
+    FunctionInfo info_;
+};
@@ -0,0 +1,334 @@
+#include "bytecode_cache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+
+namespace {
+
+constexpr char kMagic[4] = {'I', 'S', 'C', '\0'};
+
+// FNV-1a, enough to tell an edited script from the one the cache was built from
+// and a damaged payload from the one that was written.
+uint64_t hash_bytes(std::string_view bytes) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : bytes) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+
+class Writer {
+public:
+    template <typename T>
+    void write(T value) {
+        buffer_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void write_string(const std::string& str) {
+        write<uint32_t>(str.size());
+        buffer_.append(str);
+    }
+
+    void write_value(const Value& value) {
+        write<uint8_t>(static_cast<uint8_t>(value.type()));
+        switch (value.type()) {
+            case ValueType::nil: break;
+            case ValueType::boolean: write<uint8_t>(value.as_bool()); break;
+            case ValueType::number: write<double>(value.as_number()); break;
+            case ValueType::string: write_string(value.as_string()); break;
+            default:
+                throw std::runtime_error("constant cannot be cached");
+        }
+    }
+
+    void write_prototype(const FunctionPrototype& prototype) {
+        write<uint32_t>(prototype.arity_);
+        write<uint32_t>(prototype.frame_.size_);
+        write<uint8_t>(prototype.frame_.captured_);
+        write_string(prototype.info_.name_);
+        write<uint32_t>(prototype.info_.line_);
+        write<uint32_t>(prototype.info_.id_);
+
+        write<uint32_t>(prototype.code_.size());
+        buffer_.append(reinterpret_cast<const char*>(prototype.code_.data()), prototype.code_.size() * sizeof(Instruction));
+        buffer_.append(reinterpret_cast<const char*>(prototype.lines_.data()), prototype.lines_.size() * sizeof(uint32_t));
+
+        write<uint32_t>(prototype.constants_.size());
+        for (const auto& constant : prototype.constants_)
+            write_value(constant);
+
+        write<uint32_t>(prototype.bindings_.size());
+        for (const auto& binding : prototype.bindings_) {
+            write_string(binding.name_);
+            write<int32_t>(binding.local_slot_);
+            write<uint32_t>(binding.candidates_.size());
+            for (const auto& ref : binding.candidates_) {
+                write<uint32_t>(ref.depth_);
+                write<uint32_t>(ref.slot_);
+            }
+        }
+
+        write<uint32_t>(prototype.functions_.size());
+        for (const auto& function : prototype.functions_)
+            write_prototype(*function);
+    }
+
+    const std::string& buffer() const { return buffer_; }
+
+private:
+    std::string buffer_;
+};
+
+
+// Reads what Writer wrote; throws on a truncated or malformed file.
+class Reader {
+public:
+    Reader(std::string_view data) : data_(data), pos_(0) {}
+
+    template <typename T>
+    T read() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string read_string() {
+        uint32_t size = read<uint32_t>();
+        return std::string(take(size), size);
+    }
+
+    Value read_value() {
+        switch (static_cast<ValueType>(read<uint8_t>())) {
+            case ValueType::nil: return Value();
+            case ValueType::boolean: return Value(read<uint8_t>() != 0);
+            case ValueType::number: return Value::make_number(read<double>());
+            case ValueType::string: return Value(read_string());
+            default:
+                throw std::runtime_error("bad constant");
+        }
+    }
+
+    std::unique_ptr<FunctionPrototype> read_prototype() {
+        auto prototype = std::make_unique<FunctionPrototype>();
+        prototype->arity_ = read<uint32_t>();
+        prototype->frame_.size_ = read<uint32_t>();
+        prototype->frame_.captured_ = read<uint8_t>() != 0;
+        prototype->info_.name_ = read_string();
+        prototype->info_.line_ = read<uint32_t>();
+        prototype->info_.id_ = read<uint32_t>();
+
+        uint32_t code_size = read<uint32_t>();
+        prototype->code_.resize(code_size);
+        std::memcpy(prototype->code_.data(), take(code_size * sizeof(Instruction)), code_size * sizeof(Instruction));
+        prototype->lines_.resize(code_size);
+        std::memcpy(prototype->lines_.data(), take(code_size * sizeof(uint32_t)), code_size * sizeof(uint32_t));
+
+        uint32_t constant_count = read<uint32_t>();
+        prototype->constants_.reserve(constant_count);
+        for (uint32_t i = 0; i < constant_count; ++i)
+            prototype->constants_.push_back(read_value());
+
+        uint32_t binding_count = read<uint32_t>();
+        prototype->bindings_.reserve(binding_count);
+        for (uint32_t i = 0; i < binding_count; ++i) {
+            Binding& binding = prototype->bindings_.emplace_back(read_string());
+            binding.local_slot_ = read<int32_t>();
+            uint32_t candidate_count = read<uint32_t>();
+            for (uint32_t j = 0; j < candidate_count; ++j) {
+                uint32_t depth = read<uint32_t>();
+                uint32_t slot = read<uint32_t>();
+                binding.candidates_.push_back({depth, slot});
+            }
+        }
+
+        uint32_t function_count = read<uint32_t>();
+        for (uint32_t i = 0; i < function_count; ++i)
+            prototype->functions_.push_back(read_prototype());
+        return prototype;
+    }
+
+    bool at_end() const { return pos_ == data_.size(); }
+    std::string_view rest() const { return data_.substr(pos_); }
+
+private:
+    std::string_view data_;
+    size_t pos_;
+
+    const char* take(size_t size) {
+        if (size > data_.size() - pos_)
+            throw std::runtime_error("truncated cache");
+        const char* ptr = data_.data() + pos_;
+        pos_ += size;
+        return ptr;
+    }
+};
+
+// Checks that every operand of prototype and of its nested functions is in range, so that
+// the VM never indexes past a table or the code. scopes holds the frame sizes of the
+// enclosing functions, outermost first, and that of prototype itself last.
+bool is_valid(const FunctionPrototype& prototype, std::vector<size_t>& scopes) {
+    size_t frame_size = scopes.back();
+    if (prototype.arity_ > frame_size)
+        return false;
+
+    for (const auto& binding : prototype.bindings_) {
+        if (binding.local_slot_ < -1 || binding.local_slot_ >= static_cast<int64_t>(frame_size))
+            return false;
+        for (const auto& ref : binding.candidates_) {
+            if (ref.depth_ >= scopes.size() || ref.slot_ >= scopes[scopes.size() - 1 - ref.depth_])
+                return false;
+        }
+    }
+
+    const auto& code = prototype.code_;
+    if (code.empty() || get_opcode(code.back()) != OpCode::return_value)
+        return false;
+    for (size_t ip = 0; ip < code.size(); ++ip) {
+        OpCode op = get_opcode(code[ip]);
+        uint32_t arg = get_operand(code[ip]);
+        switch (op) {
+            case OpCode::constant:
+                if (arg >= prototype.constants_.size())
+                    return false;
+                break;
+            case OpCode::get_var:
+            case OpCode::increment:
+            case OpCode::decrement:
+                if (arg >= prototype.bindings_.size())
+                    return false;
+                break;
+            case OpCode::set_var:
+                if (arg >= prototype.bindings_.size() || prototype.bindings_[arg].local_slot_ < 0)
+                    return false;
+                break;
+            case OpCode::jump:
+            case OpCode::jump_if_false:
+            case OpCode::and_jump:
+            case OpCode::or_jump:
+            case OpCode::for_next:
+                if (arg >= code.size())
+                    return false;
+                break;
+            case OpCode::slice:
+                if (arg > 2)
+                    return false;
+                break;
+            case OpCode::make_function:
+                if (arg >= prototype.functions_.size())
+                    return false;
+                break;
+            case OpCode::inline_guard:
+                if (ip + 2 >= code.size())
+                    return false;
+                break;
+            default:
+                if (op > OpCode::return_value)
+                    return false;
+                break;
+        }
+    }
+
+    for (const auto& function : prototype.functions_) {
+        scopes.push_back(function->frame_.size_);
+        bool valid = is_valid(*function, scopes);
+        scopes.pop_back();
+        if (!valid)
+            return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+
+BytecodeCache::BytecodeCache(std::string path, std::string_view source, int optimization_level)
+    : path_(std::move(path)), source_hash_(hash_bytes(source)), optimization_level_(optimization_level) {}
+
+
+std::string BytecodeCache::path_for(const std::string& script) {
+    return script + ".isc";
+}
+
+
+std::optional<CompiledProgram> BytecodeCache::load() const {
+    std::ifstream file(path_, std::ios::binary);
+    if (!file)
+        return std::nullopt;
+    std::string data(std::istreambuf_iterator<char>(file), {});
+
+    try {
+        Reader reader(data);
+        for (char c : kMagic) {
+            if (reader.read<char>() != c)
+                return std::nullopt;
+        }
+        if (reader.read<uint32_t>() != kVersion ||
+            reader.read<uint32_t>() != optimization_level_ ||
+            reader.read<uint64_t>() != source_hash_ ||
+            reader.read<uint64_t>() != hash_bytes(reader.rest()))
+            return std::nullopt;
+
+        CompiledProgram program;
+        uint32_t global_count = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < global_count; ++i)
+            program.globals_.push_back(reader.read_string());
+        program.main_ = reader.read_prototype();
+        if (!reader.at_end())
+            return std::nullopt;
+        // The program frame is the global environment.
+        std::vector<size_t> scopes = {program.globals_.size()};
+        if (!is_valid(*program.main_, scopes))
+            return std::nullopt;
+        return program;
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+}
+
+
+void BytecodeCache::store(const CompiledProgram& program) const {
+    Writer payload;
+    try {
+        payload.write<uint32_t>(program.globals_.size());
+        for (const auto& name : program.globals_)
+            payload.write_string(name);
+        payload.write_prototype(*program.main_);
+    } catch (const std::exception&) {
+        return;
+    }
+    Writer header;
+    for (char c : kMagic)
+        header.write<char>(c);
+    header.write<uint32_t>(kVersion);
+    header.write<uint32_t>(optimization_level_);
+    header.write<uint64_t>(source_hash_);
+    header.write<uint64_t>(hash_bytes(payload.buffer()));
+
+    // Written aside under a name of its own and renamed, so that concurrent runs neither
+    // see half a file nor write into the same one.
+    std::random_device random;
+    std::string temp_path;
+    std::ofstream file;
+    for (int attempt = 0; attempt < 8 && !file.is_open(); ++attempt) {
+        temp_path = path_ + "." + std::to_string(random()) + ".tmp";
+        file.open(temp_path, std::ios::binary | std::ios::noreplace);
+    }
+    if (!file.is_open())
+        return;
+    file.write(header.buffer().data(), header.buffer().size());
+    file.write(payload.buffer().data(), payload.buffer().size());
+    file.close();
+    std::error_code error;
+    if (!file) {
+        std::filesystem::remove(temp_path, error);
+        return;
+    }
+    std::filesystem::rename(temp_path, path_, error);
+    if (error)
+        std::filesystem::remove(temp_path, error);
+}
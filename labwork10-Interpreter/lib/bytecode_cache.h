@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "bytecode.h"
+
+
+// Everything the VM needs to run a script: the names of the globals and the compiled program.
+struct CompiledProgram {
+    std::vector<std::string> globals_;
+    std::unique_ptr<FunctionPrototype> main_;
+};
+
+// Compiled form of a script stored next to it in a .isc file, so that unchanged scripts skip
+// lexing, parsing and compilation. The header holds the format version, the optimization
+// level and a hash of the source; any mismatch makes the file stale. A checksum of the rest
+// and a check of every operand keep a damaged file from reaching the VM.
+class BytecodeCache {
+public:
+    BytecodeCache(std::string path, std::string_view source, int optimization_level);
+
+    // script.is -> script.is.isc; appended, so that no script is its own cache file
+    static std::string path_for(const std::string& script);
+
+    // The cached program, or nullopt if the file is missing, stale or damaged.
+    std::optional<CompiledProgram> load() const;
+    // Best effort: a cache that cannot be written is simply not used.
+    void store(const CompiledProgram& program) const;
+
+private:
+    // Bump whenever the bytecode or the file layout changes.
+    static constexpr uint32_t kVersion = 7;
+
+    std::string path_;
+    uint64_t source_hash_;
+    uint32_t optimization_level_;
+};
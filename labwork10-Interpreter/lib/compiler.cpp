@@ -0,0 +1,438 @@
+#include "compiler.h"
+#include <utility>
+
+
+std::unique_ptr<FunctionPrototype> Compiler::compile_program(ASTNode& program) {
+    return compile_function(0, {}, program, {"<main>", 0});
+}
+
+
+std::unique_ptr<FunctionPrototype> Compiler::compile_function(size_t arity, const FrameLayout& frame, ASTNode& body,
+                                                              const FunctionInfo& info) {
+    auto prototype = std::make_unique<FunctionPrototype>();
+    prototype->arity_ = arity;
+    prototype->frame_ = frame;
+    prototype->info_ = info;
+    uint32_t enclosing_line = std::exchange(line_, info.line_);
+    contexts_.push_back({prototype.get(), {}});
+    body.compile_statement(*this, true);
+    emit(OpCode::nil);
+    emit(OpCode::return_value);
+    contexts_.pop_back();
+    line_ = enclosing_line;
+    return prototype;
+}
+
+
+Compiler::FunctionContext& Compiler::current() {
+    return contexts_.back();
+}
+
+
+uint32_t Compiler::check_operand(size_t value) {
+    if (value > kMaxOperand)
+        throw std::runtime_error("program is too large to compile");
+    return static_cast<uint32_t>(value);
+}
+
+
+size_t Compiler::emit(OpCode op, uint32_t arg) {
+    auto& code = current().prototype_->code_;
+    code.push_back(make_instruction(op, arg));
+    current().prototype_->lines_.push_back(line_);
+    return code.size() - 1;
+}
+
+
+size_t Compiler::emit_jump(OpCode op) {
+    return emit(op, 0);
+}
+
+
+void Compiler::patch_jump(size_t position) {
+    auto& code = current().prototype_->code_;
+    code[position] = make_instruction(get_opcode(code[position]), check_operand(code.size()));
+}
+
+
+size_t Compiler::position() const {
+    return contexts_.back().prototype_->code_.size();
+}
+
+
+uint32_t Compiler::add_constant(const Value& value) {
+    auto& constants = current().prototype_->constants_;
+    constants.push_back(value);
+    return check_operand(constants.size() - 1);
+}
+
+
+uint32_t Compiler::add_binding(const Binding& binding) {
+    auto& bindings = current().prototype_->bindings_;
+    bindings.push_back(binding);
+    return check_operand(bindings.size() - 1);
+}
+
+
+uint32_t Compiler::add_function(std::unique_ptr<FunctionPrototype> function) {
+    auto& functions = current().prototype_->functions_;
+    functions.push_back(std::move(function));
+    return check_operand(functions.size() - 1);
+}
+
+
+void Compiler::begin_loop(size_t continue_target) {
+    current().loops_.push_back({continue_target, {}});
+}
+
+
+void Compiler::end_loop() {
+    auto loop = std::move(current().loops_.back());
+    current().loops_.pop_back();
+    for (size_t jump : loop.breaks_)
+        patch_jump(jump);
+}
+
+
+// Outside of a loop the tree walker unwinds to the enclosing function with nil.
+void Compiler::emit_break() {
+    auto& loops = current().loops_;
+    if (loops.empty()) {
+        emit(OpCode::nil);
+        emit(OpCode::return_value);
+        return;
+    }
+    size_t jump = emit_jump(OpCode::jump);
+    current().loops_.back().breaks_.push_back(jump);
+}
+
+
+void Compiler::emit_continue() {
+    auto& loops = current().loops_;
+    if (loops.empty()) {
+        emit(OpCode::nil);
+        emit(OpCode::return_value);
+        return;
+    }
+    emit(OpCode::jump, check_operand(loops.back().continue_target_));
+}
+
+
+void ASTNode::compile_statement(Compiler& compiler, bool is_tail) {
+    compile(compiler);
+    compiler.emit(is_tail ? OpCode::return_value : OpCode::pop);
+}
+
+
+void NumberNode::compile(Compiler& compiler) {
+    compiler.emit(OpCode::constant, compiler.add_constant(value_));
+}
+
+
+void NilNode::compile(Compiler& compiler) {
+    compiler.emit(OpCode::nil);
+}
+
+
+void StringNode::compile(Compiler& compiler) {
+    compiler.emit(OpCode::constant, compiler.add_constant(Value(value_)));
+}
+
+
+void ConstantNode::compile(Compiler& compiler) {
+    compiler.emit(OpCode::constant, compiler.add_constant(value_));
+}
+
+
+void AssignmentNode::compile(Compiler& compiler) {
+    expr_->compile(compiler);
+    compiler.emit(OpCode::dup);
+    compiler.emit(OpCode::set_var, compiler.add_binding(binding_));
+}
+
+void AssignmentNode::compile_statement(Compiler& compiler, bool is_tail) {
+    if (is_tail) {
+        compile(compiler);
+        compiler.emit(OpCode::return_value);
+        return;
+    }
+    expr_->compile(compiler);
+    compiler.emit(OpCode::set_var, compiler.add_binding(binding_));
+}
+
+
+void IncrementNode::compile(Compiler& compiler) {
+    compiler.emit(OpCode::constant, compiler.add_constant(step_));
+    compiler.emit(op_ == TokenType::plus_ ? OpCode::increment : OpCode::decrement, compiler.add_binding(binding_));
+}
+
+
+void BinaryOpNode::compile(Compiler& compiler) {
+    left_->compile(compiler);
+    right_->compile(compiler);
+    switch (op_) {
+        case TokenType::plus_: compiler.emit(OpCode::add); break;
+        case TokenType::minus_: compiler.emit(OpCode::sub); break;
+        case TokenType::mul_: compiler.emit(OpCode::mul); break;
+        case TokenType::div_: compiler.emit(OpCode::div); break;
+        case TokenType::percent_: compiler.emit(OpCode::mod); break;
+        case TokenType::pow_: compiler.emit(OpCode::pow); break;
+        case TokenType::equal_: compiler.emit(OpCode::equal); break;
+        case TokenType::not_equal_: compiler.emit(OpCode::not_equal); break;
+        case TokenType::less_: compiler.emit(OpCode::less); break;
+        case TokenType::less_equal_: compiler.emit(OpCode::less_equal); break;
+        case TokenType::greater_: compiler.emit(OpCode::greater); break;
+        case TokenType::greater_equal_: compiler.emit(OpCode::greater_equal); break;
+        default:
+            throw std::runtime_error("unsupported binary operator");
+    }
+}
+
+
+void LogicalOpNode::compile(Compiler& compiler) {
+    left_->compile(compiler);
+    size_t to_end = compiler.emit_jump(op_ == TokenType::and_ ? OpCode::and_jump : OpCode::or_jump);
+    right_->compile(compiler);
+    compiler.emit(OpCode::to_bool);
+    compiler.patch_jump(to_end);
+}
+
+
+void UnaryOpNode::compile(Compiler& compiler) {
+    obj_->compile(compiler);
+    switch (op_) {
+        case TokenType::plus_: break;
+        case TokenType::minus_: compiler.emit(OpCode::negate); break;
+        case TokenType::not_: compiler.emit(OpCode::logic_not); break;
+        default:
+            throw std::runtime_error("unsupported unary operator");
+    }
+}
+
+
+void VariableNode::compile(Compiler& compiler) {
+    compiler.emit(OpCode::get_var, compiler.add_binding(binding_));
+}
+
+
+void IfNode::compile(Compiler& compiler) {
+    throw std::runtime_error("if cannot be used as an expression");
+}
+
+void IfNode::compile_statement(Compiler& compiler, bool is_tail) {
+    condition_->compile(compiler);
+    size_t to_else = compiler.emit_jump(OpCode::jump_if_false);
+    then_block_->compile_statement(compiler, is_tail);
+    size_t to_end = compiler.emit_jump(OpCode::jump);
+    compiler.patch_jump(to_else);
+    if (else_block_) {
+        else_block_->compile_statement(compiler, is_tail);
+    } else if (is_tail) {
+        compiler.emit(OpCode::nil);
+        compiler.emit(OpCode::return_value);
+    }
+    compiler.patch_jump(to_end);
+}
+
+
+void FunctionNode::compile(Compiler& compiler) {
+    auto prototype = compiler.compile_function(params_.size(), frame_, *body_, info_);
+    compiler.emit(OpCode::make_function, compiler.add_function(std::move(prototype)));
+}
+
+
+void ReturnNode::compile(Compiler& compiler) {
+    throw std::runtime_error("return cannot be used as an expression");
+}
+
+void ReturnNode::compile_statement(Compiler& compiler, bool is_tail) {
+    expr_->compile_statement(compiler, true);
+}
+
+
+void BlockNode::compile(Compiler& compiler) {
+    throw std::runtime_error("block cannot be used as an expression");
+}
+
+// In tail position the value of the last command becomes the function result,
+// matching BlockNode::execute.
+void BlockNode::compile_statement(Compiler& compiler, bool is_tail) {
+    if (commands_.empty()) {
+        if (is_tail) {
+            compiler.emit(OpCode::nil);
+            compiler.emit(OpCode::return_value);
+        }
+        return;
+    }
+    for (size_t i = 0; i < commands_.size(); ++i) {
+        compiler.set_line(commands_[i]->line_);
+        commands_[i]->compile_statement(compiler, is_tail && i + 1 == commands_.size());
+    }
+}
+
+
+void PrintNode::compile(Compiler& compiler) {
+    expr_->compile(compiler);
+    compiler.emit(OpCode::dup);
+    compiler.emit(is_ln_ ? OpCode::println : OpCode::print);
+}
+
+void PrintNode::compile_statement(Compiler& compiler, bool is_tail) {
+    if (is_tail) {
+        compile(compiler);
+        compiler.emit(OpCode::return_value);
+        return;
+    }
+    expr_->compile(compiler);
+    compiler.emit(is_ln_ ? OpCode::println : OpCode::print);
+}
+
+
+void CallNode::compile(Compiler& compiler) {
+    function_->compile(compiler);
+    for (auto& arg : arguments_) {
+        arg->compile(compiler);
+    }
+    compiler.emit(OpCode::call, static_cast<uint32_t>(arguments_.size()));
+}
+
+void CallNode::compile_statement(Compiler& compiler, bool is_tail) {
+    if (!is_tail) {
+        compile(compiler);
+        compiler.emit(OpCode::pop);
+        return;
+    }
+    function_->compile(compiler);
+    for (auto& arg : arguments_) {
+        arg->compile(compiler);
+    }
+    compiler.emit(OpCode::tail_call, static_cast<uint32_t>(arguments_.size()));
+    compiler.emit(OpCode::return_value);
+}
+
+
+// The guard falls through to the inlined body or jumps to an ordinary call;
+// the arguments are compiled into both.
+void InlineCallNode::compile(Compiler& compiler) {
+    function_->compile(compiler);
+    compiler.emit(OpCode::inline_guard, function_id_);
+    size_t to_call = compiler.emit_jump(OpCode::jump);
+    std::vector<uint32_t> bindings;
+    for (size_t i = 0; i < arguments_.size(); ++i) {
+        arguments_[i]->compile(compiler);
+        bindings.push_back(compiler.add_binding(params_[i]));
+        compiler.emit(OpCode::set_var, bindings.back());
+    }
+    body_->compile(compiler);
+    // Like the frame of a real call, the parameters do not outlive it.
+    for (uint32_t binding : bindings) {
+        compiler.emit(OpCode::nil);
+        compiler.emit(OpCode::set_var, binding);
+    }
+    size_t to_end = compiler.emit_jump(OpCode::jump);
+    compiler.patch_jump(to_call);
+    for (auto& arg : arguments_) {
+        arg->compile(compiler);
+    }
+    compiler.emit(OpCode::call, static_cast<uint32_t>(arguments_.size()));
+    compiler.patch_jump(to_end);
+}
+
+
+void WhileNode::compile(Compiler& compiler) {
+    throw std::runtime_error("while cannot be used as an expression");
+}
+
+void WhileNode::compile_statement(Compiler& compiler, bool is_tail) {
+    size_t loop_start = compiler.position();
+    condition_->compile(compiler);
+    size_t to_exit = compiler.emit_jump(OpCode::jump_if_false);
+    compiler.begin_loop(loop_start);
+    body_->compile_statement(compiler, false);
+    compiler.set_line(line_);
+    compiler.emit(OpCode::jump, static_cast<uint32_t>(loop_start));
+    compiler.patch_jump(to_exit);
+    compiler.end_loop();
+    if (is_tail) {
+        compiler.emit(OpCode::nil);
+        compiler.emit(OpCode::return_value);
+    }
+}
+
+
+void ContinueNode::compile(Compiler& compiler) {
+    throw std::runtime_error("continue cannot be used as an expression");
+}
+
+void ContinueNode::compile_statement(Compiler& compiler, bool is_tail) {
+    compiler.emit_continue();
+}
+
+
+void ForNode::compile(Compiler& compiler) {
+    throw std::runtime_error("for cannot be used as an expression");
+}
+
+void ForNode::compile_statement(Compiler& compiler, bool is_tail) {
+    range_->compile(compiler);
+    compiler.emit(OpCode::for_prep);
+    size_t loop_start = compiler.position();
+    size_t to_exit = compiler.emit_jump(OpCode::for_next);
+    compiler.emit(OpCode::set_var, compiler.add_binding(var_binding_));
+    compiler.begin_loop(loop_start);
+    body_->compile_statement(compiler, false);
+    compiler.set_line(line_);
+    compiler.emit(OpCode::jump, static_cast<uint32_t>(loop_start));
+    compiler.patch_jump(to_exit);
+    compiler.end_loop();
+    compiler.emit(OpCode::pop);
+    compiler.emit(OpCode::pop);
+    if (is_tail) {
+        compiler.emit(OpCode::nil);
+        compiler.emit(OpCode::return_value);
+    }
+}
+
+
+void BreakNode::compile(Compiler& compiler) {
+    throw std::runtime_error("break cannot be used as an expression");
+}
+
+void BreakNode::compile_statement(Compiler& compiler, bool is_tail) {
+    compiler.emit_break();
+}
+
+
+void ListNode::compile(Compiler& compiler) {
+    for (auto& element : elements_) {
+        element->compile(compiler);
+    }
+    compiler.emit(OpCode::make_list, static_cast<uint32_t>(elements_.size()));
+}
+
+
+void DictNode::compile(Compiler& compiler) {
+    for (auto& [key, value] : entries_) {
+        key->compile(compiler);
+        value->compile(compiler);
+    }
+    compiler.emit(OpCode::make_dict, static_cast<uint32_t>(entries_.size()));
+}
+
+
+void IndexNode::compile(Compiler& compiler) {
+    target_->compile(compiler);
+    if (!idx_ && !end_idx_) {
+        compiler.emit(OpCode::slice, 2);
+    } else if (!idx_) {
+        end_idx_->compile(compiler);
+        compiler.emit(OpCode::slice, 1);
+    } else if (!end_idx_) {
+        idx_->compile(compiler);
+        compiler.emit(OpCode::index);
+    } else {
+        idx_->compile(compiler);
+        end_idx_->compile(compiler);
+        compiler.emit(OpCode::slice, 0);
+    }
+}
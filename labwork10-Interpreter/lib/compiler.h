@@ -0,0 +1,49 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "bytecode.h"
+#include "ast.h"
+
+
+// Lowers the AST produced by Parser::parse() into bytecode for VirtualMachine.
+// Nodes emit their own code through ASTNode::compile, using the helpers below.
+class Compiler {
+public:
+    std::unique_ptr<FunctionPrototype> compile_program(ASTNode& program);
+    std::unique_ptr<FunctionPrototype> compile_function(size_t arity, const FrameLayout& frame, ASTNode& body,
+                                                        const FunctionInfo& info);
+
+    // The source line recorded for the instructions emitted next.
+    void set_line(uint32_t line) { line_ = line; }
+    size_t emit(OpCode op, uint32_t arg = 0);
+    size_t emit_jump(OpCode op);
+    void patch_jump(size_t position);
+    size_t position() const;
+
+    uint32_t add_constant(const Value& value);
+    uint32_t add_binding(const Binding& binding);
+    uint32_t add_function(std::unique_ptr<FunctionPrototype> function);
+
+    void begin_loop(size_t continue_target);
+    void end_loop();
+    void emit_break();
+    void emit_continue();
+
+private:
+    struct LoopContext {
+        size_t continue_target_;
+        std::vector<size_t> breaks_;
+    };
+
+    struct FunctionContext {
+        FunctionPrototype* prototype_;
+        std::vector<LoopContext> loops_;
+    };
+
+    std::vector<FunctionContext> contexts_;
+    uint32_t line_ = 0;
+
+    FunctionContext& current();
+    static uint32_t check_operand(size_t value);
+};
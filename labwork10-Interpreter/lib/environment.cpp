@@ -1,52 +1,157 @@
 #include "environment.h"
 #include "value.h"
 #include "ast.h"
-#include "std_lib.h"        
+#include "std_lib.h"
+#include <algorithm>
+#include <memory>
 
-Environment::Environment() : parent_(nullptr) {}
 
-Environment::Environment(std::shared_ptr<Environment> parent)
-    : parent_(std::move(parent)) {}
+Environment::Environment(Ref<Environment> parent, size_t size, bool in_arena)
+    : GcObject(!in_arena), parent_(std::move(parent)), size_(static_cast<uint32_t>(size)), in_arena_(in_arena) {
+    values_ = reinterpret_cast<Value*>(this + 1);
+    is_defined_ = reinterpret_cast<bool*>(values_ + size);
+    std::uninitialized_value_construct_n(values_, size);
+    std::fill_n(is_defined_, size, false);
+}
+
+Environment::~Environment() {
+    std::destroy_n(values_, size_);
+}
+
+void Environment::operator delete(void* ptr) {
+    ::operator delete(ptr);
+}
+
+void Environment::trace(GcVisitor& visitor) const {
+    visitor.visit(parent_.get());
+    for (uint32_t i = 0; i < size_; ++i)
+        visitor.visit(values_[i].heap_object());
+}
+
+void Environment::clear() {
+    parent_ = Ref<Environment>();
+    for (uint32_t i = 0; i < size_; ++i) {
+        Value value = std::move(values_[i]);
+        is_defined_[i] = false;
+    }
+}
+
+
+size_t Environment::allocation_size(size_t size) {
+    constexpr size_t align = alignof(std::max_align_t);
+    size_t bytes = sizeof(Environment) + size * (sizeof(Value) + sizeof(bool));
+    return (bytes + align - 1) / align * align;
+}
+
+
+Ref<Environment> Environment::create(Ref<Environment> parent, size_t size) {
+    void* memory = ::operator new(allocation_size(size));
+    return Ref<Environment>(new (memory) Environment(std::move(parent), size, false));
+}
+
+
+Ref<Environment> Environment::create_global(const std::vector<std::string>& names) {
+    auto env = create(Ref<Environment>(), names.size());
+    for (size_t slot = 0; slot < names.size(); ++slot) {
+        if (const StdlibFunction* func = find_stdlib_function(names[slot]))
+            env->declare(slot, Value::make_stdlib_func(func));
+    }
+    return env;
+}
 
 
-std::shared_ptr<Environment> Environment::create_global() {
-    auto env = std::make_shared<Environment>();
-    auto& table = get_stdlib_functions();
-    for (auto &func : table) {
-        env->declare(func.first, Value::make_stdlib_func(func.first));
+Environment* Environment::ancestor(uint32_t depth) {
+    Environment* env = this;
+    for (; depth > 0; --depth) {
+        env = env->parent_.get();
     }
     return env;
 }
 
-std::shared_ptr<Environment> Environment::create_child(std::shared_ptr<Environment> parent) {
-    return std::make_shared<Environment>(std::move(parent));
+const Environment* Environment::ancestor(uint32_t depth) const {
+    return const_cast<Environment*>(this)->ancestor(depth);
+}
+
+
+void Environment::declare(size_t slot, const Value& value) {
+    values_[slot] = value;
+    is_defined_[slot] = true;
+}
+
+
+Value* Environment::find(const Binding& binding) {
+    for (const auto& ref : binding.candidates_) {
+        Environment* env = ancestor(ref.depth_);
+        if (env->is_defined_[ref.slot_]) {
+            return &env->values_[ref.slot_];
+        }
+    }
+    return nullptr;
+}
+
+const Value* Environment::find(const Binding& binding) const {
+    return const_cast<Environment*>(this)->find(binding);
 }
 
 
-void Environment::declare(const std::string& name, const Value& value) {
-    values_[name] = value;
+void Environment::assign(const Binding& binding, const Value& value) {
+    Value* target = find(binding);
+    if (!target)
+        throw std::runtime_error("undefined variable: " + binding.name_);
+    *target = value;
 }
 
 
-void Environment::assign(const std::string& name, const Value& value) {
-    auto it = values_.find(name);
-    if (it != values_.end()) {
-        it->second = value;
-    } else if (parent_) {
-        parent_->assign(name, value);
-    } else {
-        throw std::runtime_error("undefined variable: " + name);
+void Environment::assign_or_declare(const Binding& binding, const Value& value) {
+    if (Value* target = find(binding)) {
+        *target = value;
+        return;
     }
+    declare(binding.local_slot_, value);
 }
 
 
-Value Environment::get(const std::string& name) const {
-    auto it = values_.find(name);
-    if (it != values_.end()) {
-        return it->second;
+const Value& Environment::get(const Binding& binding) const {
+    const Value* value = find(binding);
+    if (!value)
+        throw std::runtime_error("undefined variable: " + binding.name_);
+    return *value;
+}
+
+
+Environment* FrameArena::enter(const Ref<Environment>& closure, const FrameLayout& layout) {
+    if (layout.captured_) {
+        Ref<Environment> frame = Environment::create(closure, layout.size_);
+        retain(frame.get());
+        return frame.get();
+    }
+
+    size_t bytes = Environment::allocation_size(layout.size_);
+    if (blocks_.empty() || blocks_[current_].used_ + bytes > blocks_[current_].size_) {
+        if (!blocks_.empty() && blocks_[current_].used_ != 0)
+            ++current_;
+        size_t size = std::max(kBlockSize, bytes);
+        if (current_ == blocks_.size())
+            blocks_.push_back({std::make_unique<std::byte[]>(size), size});
+        else if (blocks_[current_].size_ < bytes)
+            blocks_[current_] = {std::make_unique<std::byte[]>(size), size};
     }
-    if (parent_) {
-        return parent_->get(name);
+
+    Block& block = blocks_[current_];
+    void* memory = block.data_.get() + block.used_;
+    block.used_ += bytes;
+    return new (memory) Environment(closure, layout.size_, true);
+}
+
+
+void FrameArena::leave(Environment* frame) {
+    if (!frame->in_arena_) {
+        release(frame);
+        return;
     }
-    throw std::runtime_error("undefined variable: " + name);
-}
\ No newline at end of file
+    Block& block = blocks_[current_];
+    frame->~Environment();
+    block.used_ = static_cast<size_t>(reinterpret_cast<std::byte*>(frame) - block.data_.get());
+    if (block.used_ == 0 && current_ > 0)
+        --current_;
+}
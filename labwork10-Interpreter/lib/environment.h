@@ -1,21 +1,107 @@
 #pragma once
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include <memory>
 #include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+#include "heap.h"
 
 class Value;
 
-class Environment {
-    std::unordered_map<std::string, Value> values_;
-    std::shared_ptr<Environment> parent_;
+struct SlotRef {
+    uint32_t depth_;    // number of parent_ hops from the scope of the reference
+    uint32_t slot_;
+};
+
+// Static address of a variable, filled in by Resolver. A name may be declared in several
+// enclosing scopes; the first one defined at run time wins, as with the old name lookup.
+struct Binding {
+    std::string name_;
+    std::vector<SlotRef> candidates_;   // innermost scope first
+    int local_slot_ = -1;               // slot in the own scope, or -1 if the name is never assigned there
+
+    Binding(std::string name) : name_(std::move(name)) {}
+};
+
+// Shape of the activation frame of a function, filled in by Resolver.
+struct FrameLayout {
+    size_t size_ = 0;
+    bool captured_ = false;     // the body creates closures, so the frame may outlive the call
+};
+
+// One scope: the globals or the activation frame of a single call. The slots are stored
+// right after the object, so a frame is a single allocation, either on the heap or in a FrameArena.
+class Environment : public GcObject {
+    Ref<Environment> parent_;
+    uint32_t size_;
+    bool in_arena_;
+    Value* values_;
+    bool* is_defined_;
+
+    Environment(Ref<Environment> parent, size_t size, bool in_arena);
+
+    Environment* ancestor(uint32_t depth);
+    const Environment* ancestor(uint32_t depth) const;
+
+    friend class FrameArena;
 public:
-    Environment();
-    Environment(std::shared_ptr<Environment> parent);
-
-    static std::shared_ptr<Environment> create_global();
-    static std::shared_ptr<Environment> create_child(std::shared_ptr<Environment> parent);
-    void declare(const std::string& name, const Value& value);
-    void assign(const std::string& name, const Value& value);
-    Value get(const std::string& name) const;
-};
\ No newline at end of file
+    // Bytes taken by a frame with size slots.
+    static size_t allocation_size(size_t size);
+
+    ~Environment() override;
+    static void operator delete(void* ptr);
+
+    void trace(GcVisitor& visitor) const override;
+    void clear() override;
+
+    static Ref<Environment> create(Ref<Environment> parent, size_t size);
+    static Ref<Environment> create_global(const std::vector<std::string>& names);
+    void declare(size_t slot, const Value& value);
+    // Returns the first defined candidate of binding, or nullptr if none is defined yet.
+    Value* find(const Binding& binding);
+    const Value* find(const Binding& binding) const;
+    void assign(const Binding& binding, const Value& value);
+    // Assigns to an existing variable or, failing that, declares binding.local_slot_ here.
+    void assign_or_declare(const Binding& binding, const Value& value);
+    const Value& get(const Binding& binding) const;
+};
+
+// Stack of activation frames owned by the interpreter. Frames of functions that create no
+// closures are bump-allocated here and released on return; captured frames go to the heap
+// and live as long as some closure refers to them.
+class FrameArena {
+public:
+    FrameArena() = default;
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    Environment* enter(const Ref<Environment>& closure, const FrameLayout& layout);
+    void leave(Environment* frame);
+
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    struct Block {
+        std::unique_ptr<std::byte[]> data_;
+        size_t size_;
+        size_t used_ = 0;
+    };
+
+    std::vector<Block> blocks_;
+    size_t current_ = 0;
+};
+
+// Keeps a frame entered for the lifetime of a call of the tree walker.
+class FrameGuard {
+    FrameArena& arena_;
+    Environment* frame_;
+public:
+    FrameGuard(FrameArena& arena, const Ref<Environment>& closure, const FrameLayout& layout)
+        : arena_(arena), frame_(arena.enter(closure, layout)) {}
+    FrameGuard(const FrameGuard&) = delete;
+    FrameGuard& operator=(const FrameGuard&) = delete;
+    ~FrameGuard() { arena_.leave(frame_); }
+
+    Environment* get() const { return frame_; }
+};
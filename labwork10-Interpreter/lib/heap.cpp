@@ -0,0 +1,109 @@
+#include "heap.h"
+#include <algorithm>
+#include <vector>
+
+
+namespace {
+
+template <typename F>
+class FunctionVisitor : public GcVisitor {
+    F f_;
+public:
+    explicit FunctionVisitor(F f) : f_(f) {}
+protected:
+    void visit_tracked(GcObject* object) override { f_(object); }
+};
+
+}  // namespace
+
+
+GcObject::GcObject(bool tracked) {
+    if (tracked)
+        CycleCollector::track(this);
+}
+
+GcObject::~GcObject() {
+    if (tracked_)
+        CycleCollector::untrack(this);
+}
+
+
+// A collection may run here, before the new object joins the list: everything else is
+// either referenced from outside or unreachable, so the collector sees a consistent heap.
+void CycleCollector::track(GcObject* object) {
+    if (threshold_ != 0 && ++allocations_ >= next_collection_)
+        collect();
+    object->tracked_ = true;
+    object->gc_next_ = first_;
+    if (first_)
+        first_->gc_prev_ = object;
+    first_ = object;
+    ++stats_.tracked_;
+}
+
+void CycleCollector::untrack(GcObject* object) {
+    if (object->gc_prev_)
+        object->gc_prev_->gc_next_ = object->gc_next_;
+    else
+        first_ = object->gc_next_;
+    if (object->gc_next_)
+        object->gc_next_->gc_prev_ = object->gc_prev_;
+    --stats_.tracked_;
+}
+
+
+void CycleCollector::set_threshold(size_t threshold) {
+    threshold_ = threshold;
+    next_collection_ = std::max(threshold_, stats_.tracked_);
+}
+
+
+size_t CycleCollector::collect() {
+    if (collecting_)
+        return 0;
+    collecting_ = true;
+
+    for (GcObject* object = first_; object; object = object->gc_next_)
+        object->gc_refs_ = object->ref_count_;
+    FunctionVisitor subtract([](GcObject* child) { --child->gc_refs_; });
+    for (GcObject* object = first_; object; object = object->gc_next_)
+        object->trace(subtract);
+
+    std::vector<GcObject*> pending;
+    for (GcObject* object = first_; object; object = object->gc_next_) {
+        if (object->gc_refs_ > 0)
+            pending.push_back(object);
+    }
+    FunctionVisitor mark([&](GcObject* child) {
+        if (child->gc_refs_ == 0) {
+            child->gc_refs_ = 1;
+            pending.push_back(child);
+        }
+    });
+    while (!pending.empty()) {
+        GcObject* object = pending.back();
+        pending.pop_back();
+        object->trace(mark);
+    }
+
+    // Holding every piece of garbage while the cycles are broken keeps each one alive
+    // until all of them are cleared.
+    std::vector<GcObject*> garbage;
+    for (GcObject* object = first_; object; object = object->gc_next_) {
+        if (object->gc_refs_ == 0) {
+            retain(object);
+            garbage.push_back(object);
+        }
+    }
+    for (GcObject* object : garbage)
+        object->clear();
+    for (GcObject* object : garbage)
+        release(object);
+
+    ++stats_.collections_;
+    stats_.collected_ += garbage.size();
+    allocations_ = 0;
+    next_collection_ = std::max(threshold_, stats_.tracked_);
+    collecting_ = false;
+    return garbage.size();
+}
@@ -0,0 +1,154 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <cstddef>
+
+
+// Base of every value that does not fit into a Value inline (strings, lists, functions).
+// The reference count is intrusive and non-atomic: the interpreter is single-threaded.
+struct HeapObject {
+    uint32_t ref_count_ = 0;
+    bool tracked_ = false;      // a GcObject registered with the CycleCollector
+
+    HeapObject();
+    HeapObject(const HeapObject&) = delete;
+    HeapObject& operator=(const HeapObject&) = delete;
+    virtual ~HeapObject();
+};
+
+inline void retain(HeapObject* object) {
+    ++object->ref_count_;
+}
+
+inline void release(HeapObject* object) {
+    if (--object->ref_count_ == 0)
+        delete object;
+}
+
+
+// Owning pointer to a HeapObject, the intrusive counterpart of std::shared_ptr.
+template <typename T>
+class Ref {
+    T* ptr_ = nullptr;
+
+public:
+    Ref() = default;
+    explicit Ref(T* ptr) : ptr_(ptr) {
+        if (ptr_) retain(ptr_);
+    }
+    Ref(const Ref& other) : Ref(other.ptr_) {}
+    Ref(Ref&& other) noexcept : ptr_(std::exchange(other.ptr_, nullptr)) {}
+    ~Ref() {
+        if (ptr_) release(ptr_);
+    }
+
+    Ref& operator=(Ref other) noexcept {
+        std::swap(ptr_, other.ptr_);
+        return *this;
+    }
+
+    T* get() const { return ptr_; }
+    T* operator->() const { return ptr_; }
+    T& operator*() const { return *ptr_; }
+    explicit operator bool() const { return ptr_ != nullptr; }
+    bool operator==(const Ref& other) const { return ptr_ == other.ptr_; }
+};
+
+template <typename T, typename... Args>
+Ref<T> make_ref(Args&&... args) {
+    return Ref<T>(new T(std::forward<Args>(args)...));
+}
+
+
+struct HeapStats {
+    size_t objects_ = 0;        // live heap objects of every kind
+    size_t peak_objects_ = 0;
+    size_t allocations_ = 0;    // heap objects ever created
+    size_t tracked_ = 0;        // live objects registered with the CycleCollector
+    size_t collections_ = 0;
+    size_t collected_ = 0;      // objects freed by the CycleCollector
+};
+
+class GcObject;
+
+// Frees the reference cycles that reference counting alone never frees, by trial deletion.
+// The references that tracked objects hold to each other are subtracted from their counts.
+// An object left with a positive count is referenced from outside (the VM stack, an
+// activation frame, C++ code) and survives with everything it reaches; the rest is garbage
+// kept alive only by cycles. Process-wide and single-threaded, like the reference counts.
+class CycleCollector {
+public:
+    static constexpr size_t kDefaultThreshold = 10000;
+
+    // Collection runs after threshold allocations of tracked objects, or after as many as
+    // survived the last collection if that is more, so that its cost stays proportional to
+    // the allocations. 0 leaves only explicit collect() calls.
+    static void set_threshold(size_t threshold);
+    // Returns the number of objects freed.
+    static size_t collect();
+    static const HeapStats& stats() { return stats_; }
+    static void reset_peak() { stats_.peak_objects_ = stats_.objects_; }
+
+private:
+    friend struct HeapObject;
+    friend class GcObject;
+
+    static inline HeapStats stats_;
+    static inline GcObject* first_ = nullptr;
+    static inline size_t threshold_ = kDefaultThreshold;
+    static inline size_t next_collection_ = kDefaultThreshold;
+    static inline size_t allocations_ = 0;
+    static inline bool collecting_ = false;
+
+    static void track(GcObject* object);
+    static void untrack(GcObject* object);
+};
+
+inline HeapObject::HeapObject() {
+    HeapStats& stats = CycleCollector::stats_;
+    ++stats.allocations_;
+    if (++stats.objects_ > stats.peak_objects_)
+        stats.peak_objects_ = stats.objects_;
+}
+
+inline HeapObject::~HeapObject() {
+    --CycleCollector::stats_.objects_;
+}
+
+
+// Receives the references held by a GcObject.
+class GcVisitor {
+public:
+    virtual ~GcVisitor() = default;
+    // Skips null pointers and objects that cannot be part of a cycle.
+    void visit(HeapObject* object);
+
+protected:
+    virtual void visit_tracked(GcObject* object) = 0;
+};
+
+// A heap object that can refer to other heap objects, and so be part of a reference cycle:
+// lists, dictionaries, functions and the environments they capture.
+class GcObject : public HeapObject {
+public:
+    // Frames allocated in a FrameArena are not tracked: their references count as external.
+    explicit GcObject(bool tracked = true);
+    ~GcObject() override;
+
+    // Passes visitor every reference to a heap object that this one holds.
+    virtual void trace(GcVisitor& visitor) const = 0;
+    // Drops those references; called on garbage before it is freed.
+    virtual void clear() = 0;
+
+private:
+    friend class CycleCollector;
+
+    GcObject* gc_prev_ = nullptr;
+    GcObject* gc_next_ = nullptr;
+    uint32_t gc_refs_ = 0;
+};
+
+inline void GcVisitor::visit(HeapObject* object) {
+    if (object && object->tracked_)
+        visit_tracked(static_cast<GcObject*>(object));
+}
@@ -0,0 +1,72 @@
+#include "input_buffer.h"
+#include <algorithm>
+#include <cstring>
+
+
+bool InputBuffer::fill() {
+    if (eof_)
+        return false;
+    if (begin_ > 0) {
+        std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+    // Doubles for lines longer than a block.
+    if (buffer_.size() - end_ < kBlockSize)
+        buffer_.resize(std::max(buffer_.size() * 2, end_ + kBlockSize));
+
+    size_t old_end = end_;
+    std::streambuf* source = stream_.rdbuf();
+    std::streamsize available = source ? source->in_avail() : -1;
+    if (available == 0) {
+        // Nothing is buffered, so the stream has to wait for data.
+        tied_.flush();
+        std::streambuf::int_type c = source->sbumpc();
+        if (std::streambuf::traits_type::eq_int_type(c, std::streambuf::traits_type::eof())) {
+            eof_ = true;
+            return false;
+        }
+        buffer_[end_++] = std::streambuf::traits_type::to_char_type(c);
+        available = source->in_avail();
+    }
+    if (available < 0) {
+        eof_ = true;
+    } else {
+        std::streamsize room = static_cast<std::streamsize>(buffer_.size() - end_);
+        end_ += static_cast<size_t>(source->sgetn(buffer_.data() + end_, std::min(available, room)));
+    }
+    return end_ > old_end;
+}
+
+
+bool InputBuffer::read_line(std::string& line) {
+    size_t scanned = begin_;
+    for (;;) {
+        const char* newline = nullptr;
+        if (scanned < end_)
+            newline = static_cast<const char*>(std::memchr(buffer_.data() + scanned, '\n', end_ - scanned));
+        if (newline) {
+            size_t end = newline - buffer_.data();
+            line.assign(buffer_.data() + begin_, end - begin_);
+            begin_ = end + 1;
+            return true;
+        }
+        scanned = end_ - begin_;    // offset from begin_, which fill() moves to 0
+        if (!fill())
+            break;
+    }
+    if (begin_ == end_)
+        return false;
+    // The last line has no '\n'.
+    line.assign(buffer_.data() + begin_, end_ - begin_);
+    begin_ = end_;
+    return true;
+}
+
+
+std::string InputBuffer::read_all() {
+    while (fill()) {}
+    std::string rest(buffer_.data() + begin_, end_ - begin_);
+    begin_ = end_;
+    return rest;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <istream>
+#include <string>
+#include <vector>
+#include "output_buffer.h"
+
+
+// Script input read from its stream in blocks of up to kBlockSize and split into lines here,
+// so a line costs a memchr and a copy rather than a character-by-character getline.
+// A block is read only as far as the stream has data, so interactive input is not held up,
+// and the tied output is flushed before any read that may wait, so prompts are seen first.
+class InputBuffer {
+public:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    InputBuffer(std::istream& stream, OutputBuffer& tied) : stream_(stream), tied_(tied) {}
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
+    // The next line without its '\n'; false at the end of the input.
+    bool read_line(std::string& line);
+    // All the input not read yet.
+    std::string read_all();
+
+private:
+    std::istream& stream_;
+    OutputBuffer& tied_;
+    std::vector<char> buffer_;
+    size_t begin_ = 0;      // unread data is buffer_[begin_, end_)
+    size_t end_ = 0;
+    bool eof_ = false;
+
+    // Appends whatever the stream has next; false at the end of the input.
+    bool fill();
+};
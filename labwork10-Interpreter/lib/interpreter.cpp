@@ -4,30 +4,174 @@
 #include "environment.h"
 #include "ast.h"
 #include "std_lib.h"
+#include "compiler.h"
+#include "vm.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "bytecode_cache.h"
+#include <algorithm>
+#include <iterator>
 
-bool interpret_file(const std::string& filename, std::ostream& output) {
-    std::ifstream input_file(filename);
-    if (!input_file) {
-        output << "cannot open input file: " << filename << "\n";
-        return false;
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#elif defined(__unix__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+// Reads the whole program at once, so that the lexer scans one contiguous buffer.
+std::string read_source(std::istream& input) {
+    return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+std::string read_source(std::ifstream& file) {
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    if (size < 0)
+        return read_source(static_cast<std::istream&>(file));
+    std::string source(static_cast<size_t>(size), '\0');
+    file.read(source.data(), size);
+    source.resize(static_cast<size_t>(file.gcount()));
+    return source;
+}
+
+// Attaches a profiler to a run, including one cut short by an error.
+struct ProfileRun {
+    Profiler* profiler_;
+
+    explicit ProfileRun(Profiler* profiler) : profiler_(profiler) {
+        if (profiler_) profiler_->start();
+    }
+    ~ProfileRun() {
+        if (profiler_) profiler_->stop();
+    }
+};
+
+// Script calls that recurse on the native stack may use max_bytes of it below the caller,
+// less whatever the calling thread's stack cannot spare: everything below the caller minus
+// a reserve for native code called between two script calls.
+uintptr_t native_stack_limit(size_t max_bytes) {
+    constexpr size_t kReserve = 1 << 20;
+    char here;
+    uintptr_t top = reinterpret_cast<uintptr_t>(&here);
+    size_t available = kReserve;    // unknown: assume a small stack
+#if defined(__linux__)
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        void* bottom = nullptr;
+        size_t size = 0;
+        if (pthread_attr_getstack(&attr, &bottom, &size) == 0 && top > reinterpret_cast<uintptr_t>(bottom))
+            available = top - reinterpret_cast<uintptr_t>(bottom);
+        pthread_attr_destroy(&attr);
     }
-    return interpret(input_file, output);
+#elif defined(__APPLE__)
+    // pthread_get_stackaddr_np returns the upper end of the stack.
+    pthread_t self = pthread_self();
+    uintptr_t bottom = reinterpret_cast<uintptr_t>(pthread_get_stackaddr_np(self)) - pthread_get_stacksize_np(self);
+    if (top > bottom)
+        available = top - bottom;
+#elif defined(__unix__)
+    // No portable way to ask for the bounds of the current thread's stack; this assumes that
+    // the interpreter runs on the main thread, whose size is the RLIMIT_STACK.
+    rlimit limit{};
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        available = limit.rlim_cur;
+#endif
+    size_t budget = std::min<size_t>(max_bytes, available > 2 * kReserve ? available - kReserve : available / 2);
+    return top > budget ? top - budget : 0;
+}
+
+Value run_bytecode(const CompiledProgram& program, InputBuffer& input, OutputBuffer& output,
+                   const InterpreterOptions& options) {
+    auto global_env = Environment::create_global(program.globals_);
+    FrameArena arena;
+    ProfileRun profile_run(options.profiler_);
+    VirtualMachine vm(global_env.get(), arena, output, input, options.max_stack_bytes_,
+                      native_stack_limit(options.max_stack_bytes_), options.profiler_);
+    return vm.run(*program.main_);
 }
 
+// Frees the cycles left over by a run once all of its objects are released.
+struct CollectOnExit {
+    ~CollectOnExit() { CycleCollector::collect(); }
+};
 
-bool interpret(std::istream& input, std::ostream& output) {
+// cache is used only by the bytecode VM; it may be null.
+bool run(std::string_view source, std::ostream& output, const InterpreterOptions& options,
+         const BytecodeCache* cache) {
+    CycleCollector::set_threshold(options.gc_threshold_);
+    CycleCollector::reset_peak();
+    CollectOnExit collect_on_exit;
+    OutputBuffer out(output);
+    InputBuffer in(options.input_ ? *options.input_ : std::cin, out);
     try {
-        Lexer lexer(input);
-        Parser parser(lexer);
+        if (cache && !options.tree_walk_) {
+            if (auto program = cache->load()) {
+                run_bytecode(*program, in, out, options);
+                return true;
+            }
+        }
+
+        ASTArena nodes;
+        Lexer lexer(source);
+        Parser parser(lexer, nodes);
         ASTPtr program = parser.parse();
-        auto global_env = Environment::create_global();
-        ExecutionArgs execution_args(global_env, output, input);
+        if (options.optimization_level_ > 0) {
+            Optimizer optimizer(nodes, !options.profiler_);
+            optimizer.optimize_program(program);
+        }
+        Resolver resolver;
+        resolver.resolve_program(*program);
+
+        if (options.tree_walk_) {
+            auto global_env = Environment::create_global(resolver.global_names());
+            FrameArena arena;
+            ExecutionArgs execution_args(global_env.get(), arena, out, in);
+            execution_args.profiler_ = options.profiler_;
+            execution_args.stack_limit_ = native_stack_limit(options.max_stack_bytes_);
+            ProfileRun profile_run(options.profiler_);
+            Value result = program->execute(execution_args);
+            return true;
+        }
+
+        Compiler compiler;
+        CompiledProgram bytecode{resolver.global_names(), compiler.compile_program(*program)};
+        if (cache)
+            cache->store(bytecode);
+        run_bytecode(bytecode, in, out, options);
 
-        Value result = program->execute(execution_args);
-        
         return true;
     } catch (const std::exception& e) {
-        output << "Error: " << e.what() << '\n';
+        out.write("Error: ");
+        out.write(e.what());
+        out.write("\n");
         return false;
     }
-}
\ No newline at end of file
+}
+
+}  // namespace
+
+
+bool interpret_file(const std::string& filename, std::ostream& output, const InterpreterOptions& options) {
+    std::ifstream input_file(filename, std::ios::binary);
+    if (!input_file) {
+        output << "cannot open input file: " << filename << "\n";
+        return false;
+    }
+    std::string source = read_source(input_file);
+    // A profiled run compiles the script again, without inlining.
+    std::string cache_path = BytecodeCache::path_for(filename);
+    if (!options.use_cache_ || options.profiler_ || cache_path == filename)
+        return run(source, output, options, nullptr);
+    BytecodeCache cache(std::move(cache_path), source, options.optimization_level_);
+    return run(source, output, options, &cache);
+}
+
+
+bool interpret(std::istream& input, std::ostream& output, const InterpreterOptions& options) {
+    std::string source = read_source(input);
+    return run(source, output, options, nullptr);
+}
+
@@ -2,8 +2,23 @@
 #include "parser.h"
 #include "environment.h"
 #include "ast.h"
+#include "heap.h"
+#include "profiler.h"
 #include <iostream>
 #include <fstream>
 
-bool interpret_file(const std::string& filename, std::ostream& output);
-bool interpret(std::istream& input, std::ostream& output);
\ No newline at end of file
+struct InterpreterOptions {
+    bool tree_walk_ = false;    // run ASTNode::execute directly instead of the bytecode VM
+    int optimization_level_ = 1;    // 0 runs the program exactly as parsed, 1 runs Optimizer first
+    bool use_cache_ = true;         // interpret_file: reuse the bytecode saved in script.is.isc while the script is unchanged
+    size_t gc_threshold_ = CycleCollector::kDefaultThreshold;     // see CycleCollector::set_threshold
+    Profiler* profiler_ = nullptr;  // collects per-line and per-function costs of the run when set
+    std::istream* input_ = nullptr; // read by read(), read_all(), read_lines() and lines(); std::cin when null
+    // Memory for the call stack; deeper recursion fails with "stack overflow". The tree walker,
+    // and the VM when native code such as sort() calls back into the script, recurse on the
+    // native stack and are limited by the size of the calling thread's stack as well.
+    size_t max_stack_bytes_ = 256 << 20;
+};
+
+bool interpret_file(const std::string& filename, std::ostream& output, const InterpreterOptions& options = {});
+bool interpret(std::istream& input, std::ostream& output, const InterpreterOptions& options = {});
\ No newline at end of file
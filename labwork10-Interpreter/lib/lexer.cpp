@@ -1,17 +1,8 @@
 #include "lexer.h"
-#include <iostream>
+#include <charconv>
 
-Lexer::Lexer(std::istream& input) : input_(input), line_(1), number_(0), current_char_(' ') {
-    next_char();
-}
-
-
-void Lexer::next_char() {
-    current_char_ = input_.get();
-    if (current_char_ == EOF) {
-        current_char_ = '\0';
-    }
-}
+Lexer::Lexer(std::string_view source)
+    : current_(source.data()), end_(source.data() + source.size()), line_(1), number_(0) {}
 
 
 double Lexer::get_number() {
@@ -19,7 +10,7 @@ double Lexer::get_number() {
 }
 
 
-const std::string& Lexer::get_lexeme() {
+std::string_view Lexer::get_lexeme() {
     return lexeme_;
 }
 
@@ -29,30 +20,23 @@ size_t Lexer::get_line() {
 }
 
 
-bool Lexer::is_next_equal(char expected) {
-    if (input_.peek() == expected) {
-        next_char();
-        return true;
-    }
-    return false;
+TokenType Lexer::make_token(TokenType type, const char* start) {
+    lexeme_ = std::string_view(start, current_ - start);
+    return type;
 }
 
 
 void Lexer::skip_whitespace_and_comments() {
     while (true) {
-        if (current_char_ == ' ' || current_char_ == '\t' || current_char_ == '\r') {
-            next_char();
-        } else if (current_char_ == '\n') {
+        char c = peek();
+        if (c == ' ' || c == '\t' || c == '\r') {
+            ++current_;
+        } else if (c == '\n') {
             ++line_;
-            next_char();
-        } else if (current_char_ == '/') {
-            if (input_.peek() == '/') {
-                next_char();
-                while (current_char_ != '\n' && current_char_ != '\0') {
-                    next_char();
-                }
-            } else {
-                break;
+            ++current_;
+        } else if (c == '/' && peek(1) == '/') {
+            while (peek() != '\n' && peek() != '\0') {
+                ++current_;
             }
         } else {
             break;
@@ -62,61 +46,50 @@ void Lexer::skip_whitespace_and_comments() {
 
 
 TokenType Lexer::construct_number() {
-    std::string str_number = "";
-    while (std::isdigit(current_char_)) {
-        str_number += current_char_;
-        next_char();
+    const char* start = current_;
+    while (std::isdigit(peek())) {
+        ++current_;
     }
 
-    if (current_char_ == '.') {
-        str_number += '.';
-        next_char();
-        while (std::isdigit(current_char_)) {
-            str_number += current_char_;
-            next_char();
+    if (peek() == '.') {
+        ++current_;
+        while (std::isdigit(peek())) {
+            ++current_;
         }
     }
 
-    if (current_char_ == 'e' || current_char_ == 'E') {
-        str_number += current_char_;
-        next_char();
-        if (current_char_ == '+' || current_char_ == '-') {
-            str_number += current_char_;
-            next_char();
+    if (peek() == 'e' || peek() == 'E') {
+        ++current_;
+        if (peek() == '+' || peek() == '-') {
+            ++current_;
         }
-        while (std::isdigit(current_char_)) {
-            str_number += current_char_;
-            next_char();
+        while (std::isdigit(peek())) {
+            ++current_;
         }
     }
-    lexeme_ = str_number;
-    number_ = std::strtod(str_number.c_str(), nullptr);
-    return TokenType::number_;
+
+    auto [ptr, ec] = std::from_chars(start, current_, number_);
+    if (ec == std::errc::result_out_of_range)
+        number_ = std::strtod(std::string(start, current_).c_str(), nullptr);
+    return make_token(TokenType::number_, start);
 }
 
 
 TokenType Lexer::construct_identifier() {
-    std::string ident;
-
-    if (std::isalpha(current_char_) || current_char_ == '_') {
-        ident += current_char_;
-        next_char();
-        while (std::isalnum(current_char_) || current_char_ == '_') {
-            ident += current_char_;
-            next_char();
-        }
+    const char* start = current_;
+    while (std::isalnum(peek()) || peek() == '_') {
+        ++current_;
     }
-
-    lexeme_ = ident;
+    std::string_view ident(start, current_ - start);
 
     if (ident == "end") {
         skip_whitespace_and_comments();
-        std::string second_word = "";
-        while (std::isalpha(current_char_)) {
-            second_word += current_char_;
-            next_char();
+        const char* second_start = current_;
+        while (std::isalpha(peek())) {
+            ++current_;
         }
-        lexeme_ += " " + second_word;
+        std::string_view second_word(second_start, current_ - second_start);
+        make_token(TokenType::unknown_, start);
         if (second_word == "if") return TokenType::end_if_;
         if (second_word == "for") return TokenType::end_for_;
         if (second_word == "while") return TokenType::end_while_;
@@ -125,6 +98,8 @@ TokenType Lexer::construct_identifier() {
         return unknown_;
     }
 
+    lexeme_ = ident;
+
     if (ident == "if") return TokenType::if_;
     if (ident == "then") return TokenType::then_;
     if (ident == "else") return TokenType::else_;
@@ -149,55 +124,66 @@ TokenType Lexer::construct_identifier() {
 
 
 TokenType Lexer::construct_str() {
-    std::string str;
-    next_char();
+    ++current_;
+    const char* start = current_;
 
-    while (current_char_ != '"' && current_char_ != '\0') {
-        if (current_char_ == '\n') ++line_;
-        str += current_char_;
-        next_char();
+    while (peek() != '"' && peek() != '\0') {
+        if (peek() == '\n') ++line_;
+        ++current_;
     }
 
-    lexeme_ = str;
-    if (current_char_ == '"') {
-        next_char(); 
+    make_token(TokenType::string_, start);
+    if (peek() == '"') {
+        ++current_;
         return TokenType::string_;
     }
     return TokenType::unknown_;
 }
 
 
+TokenType Lexer::construct_operator(TokenType single, TokenType with_equal) {
+    const char* start = current_++;
+    if (peek() == '=') {
+        ++current_;
+        return make_token(with_equal, start);
+    }
+    return make_token(single, start);
+}
+
+
 TokenType Lexer::next_token() {
     skip_whitespace_and_comments();
 
-    if(current_char_ == '\0') {
-        lexeme_ = "\0";
+    char c = peek();
+    if (c == '\0') {
+        lexeme_ = {};
         return TokenType::eof_;
     }
-    if (std::isdigit(current_char_)) return construct_number();
-    if (std::isalpha(current_char_) || current_char_ == '_') return construct_identifier();
-    if (current_char_ == '"') return construct_str();
-
-    switch (current_char_) {
-        case '!': next_char(); if (current_char_ == '=') { next_char(); lexeme_ = "!="; return TokenType::not_equal_; } lexeme_ = "!"; return TokenType::not_;
-        case '=': next_char(); if (current_char_ == '=') { next_char(); lexeme_ = "=="; return TokenType::equal_; } lexeme_ = "="; return TokenType::assign_;
-        case '+': next_char(); if (current_char_ == '=') { next_char(); lexeme_ = "+="; return TokenType::plus_assign_; } lexeme_ = "+"; return TokenType::plus_;
-        case '-': next_char(); if (current_char_ == '=') { next_char(); lexeme_ = "-="; return TokenType::minus_assign_; } lexeme_ = "-"; return TokenType::minus_;
-        case '*': next_char(); if (current_char_ == '=') { next_char(); lexeme_ = "*="; return TokenType::mul_assign_; } lexeme_ = "*"; return TokenType::mul_;
-        case '/': next_char(); if (current_char_ == '=') { next_char(); lexeme_ = "/="; return TokenType::div_assign_; } lexeme_ = "/"; return TokenType::div_;
-        case '%': next_char(); if (current_char_ == '=') { next_char(); lexeme_ = "%="; return TokenType::percent_assign_; } lexeme_ = "%"; return TokenType::percent_;
-        case '^': next_char(); if (current_char_ == '=') { next_char(); lexeme_ = "^="; return TokenType::pow_assign_; } lexeme_ = "^"; return TokenType::pow_;
-        case '>': next_char(); if (current_char_ == '=') { next_char(); lexeme_ = ">="; return TokenType::greater_equal_; } lexeme_ = ">"; return TokenType::greater_;
-        case '<': next_char(); if (current_char_ == '=') { next_char(); lexeme_ = "<="; return TokenType::less_equal_; } lexeme_ = "<"; return TokenType::less_;
-        case '(': next_char(); lexeme_ = "("; return TokenType::l_paren_;
-        case ')': next_char(); lexeme_ = ")"; return TokenType::r_paren_;
-        case '[': next_char(); lexeme_ = "["; return TokenType::l_bracket_;
-        case ']': next_char(); lexeme_ = "]"; return TokenType::r_bracket_;
-        case ',': next_char(); lexeme_ = ","; return TokenType::comma_;
-        case ':': next_char(); lexeme_ = ":"; return TokenType::colon_;
+    if (std::isdigit(c)) return construct_number();
+    if (std::isalpha(c) || c == '_') return construct_identifier();
+    if (c == '"') return construct_str();
+
+    switch (c) {
+        case '!': return construct_operator(TokenType::not_, TokenType::not_equal_);
+        case '=': return construct_operator(TokenType::assign_, TokenType::equal_);
+        case '+': return construct_operator(TokenType::plus_, TokenType::plus_assign_);
+        case '-': return construct_operator(TokenType::minus_, TokenType::minus_assign_);
+        case '*': return construct_operator(TokenType::mul_, TokenType::mul_assign_);
+        case '/': return construct_operator(TokenType::div_, TokenType::div_assign_);
+        case '%': return construct_operator(TokenType::percent_, TokenType::percent_assign_);
+        case '^': return construct_operator(TokenType::pow_, TokenType::pow_assign_);
+        case '>': return construct_operator(TokenType::greater_, TokenType::greater_equal_);
+        case '<': return construct_operator(TokenType::less_, TokenType::less_equal_);
+        case '(': ++current_; return make_token(TokenType::l_paren_, current_ - 1);
+        case ')': ++current_; return make_token(TokenType::r_paren_, current_ - 1);
+        case '[': ++current_; return make_token(TokenType::l_bracket_, current_ - 1);
+        case ']': ++current_; return make_token(TokenType::r_bracket_, current_ - 1);
+        case '{': ++current_; return make_token(TokenType::l_brace_, current_ - 1);
+        case '}': ++current_; return make_token(TokenType::r_brace_, current_ - 1);
+        case ',': ++current_; return make_token(TokenType::comma_, current_ - 1);
+        case ':': ++current_; return make_token(TokenType::colon_, current_ - 1);
         default:
-            lexeme_ = current_char_;
-            next_char();
-            return unknown_;
+            ++current_;
+            return make_token(TokenType::unknown_, current_ - 1);
     }
 }
@@ -1,9 +1,9 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cctype>
 #include <cstdlib>
-#include <istream>
 
 enum TokenType {
     number_,
@@ -59,6 +59,8 @@ enum TokenType {
     r_paren_,
     l_bracket_,
     r_bracket_,
+    l_brace_,
+    r_brace_,
     comma_,
     colon_,
 
@@ -69,27 +71,32 @@ enum TokenType {
 };
 
 
+// Scans a whole program held in one contiguous buffer. Lexemes are views into that
+// buffer, so it must outlive the lexer and every lexeme taken from it.
 class Lexer {
 public:
-    Lexer(std::istream& input);
+    Lexer(std::string_view source);
 
     TokenType next_token();
     double get_number();
-    const std::string& get_lexeme();
+    std::string_view get_lexeme();
     size_t get_line();
 
 private:
-    std::istream& input_;
+    const char* current_;
+    const char* end_;
     size_t line_;
-    size_t pos_;
     double number_;
-    std::string lexeme_;
-    char current_char_;
-    
-    void next_char();
+    std::string_view lexeme_;
+
+    // The character offset positions ahead, or '\0' past the end of the source.
+    char peek(size_t offset = 0) const {
+        return offset < static_cast<size_t>(end_ - current_) ? current_[offset] : '\0';
+    }
     void skip_whitespace_and_comments();
-    bool is_next_equal(char expected);
+    TokenType make_token(TokenType type, const char* start);
     TokenType construct_number();
     TokenType construct_str();
     TokenType construct_identifier();
+    TokenType construct_operator(TokenType single, TokenType with_equal);
 };
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include "optimizer.h"
+#include <cmath>
+
+
+namespace {
+
+// Folding a string or list operation builds the result now, for code that may never run.
+bool too_large_to_fold(TokenType op, const Value& lhs, const Value& rhs) {
+    auto size = [](const Value& value) -> double {
+        if (value.type() == ValueType::string)
+            return static_cast<double>(value.as_string().size());
+        if (value.type() == ValueType::list)
+            return static_cast<double>(value.as_list().size());
+        return 0;
+    };
+    double result = 0;
+    if (op == TokenType::plus_)
+        result = size(lhs) + size(rhs);
+    else if (op == TokenType::mul_ && lhs.type() == ValueType::string && rhs.type() == ValueType::number)
+        result = size(lhs) * std::ceil(rhs.as_number());
+    return !(result <= Optimizer::kMaxFoldedSize);
+}
+
+}  // namespace
+
+
+void Optimizer::optimize_program(ASTPtr& program) {
+    optimize(program);
+    if (!inline_calls_)
+        return;
+    bool has_candidates = false;
+    for (const auto& [name, assignments] : assignments_)
+        has_candidates |= assignments.count_ == 1 && assignments.function_;
+    if (!has_candidates)
+        return;
+    // The rewrites of the first pass are already done, so the second one only inlines.
+    inlining_ = true;
+    optimize(program);
+}
+
+
+void Optimizer::note_assignment(const std::string& name, const FunctionNode* function) {
+    if (inlining_)
+        return;
+    Assignments& assignments = assignments_[name];
+    ++assignments.count_;
+    assignments.function_ = function;
+}
+
+
+ASTPtr Optimizer::inline_call(ASTPtr& callee, std::vector<ASTPtr>& arguments) {
+    if (!inlining_)
+        return nullptr;
+    auto* variable = dynamic_cast<const VariableNode*>(callee.get());
+    if (!variable)
+        return nullptr;
+    auto it = assignments_.find(variable->name());
+    if (it == assignments_.end() || it->second.count_ != 1 || !it->second.function_)
+        return nullptr;
+    const FunctionNode& function = *it->second.function_;
+    const ASTNode* expression = function.single_expression();
+    if (!expression || function.params().size() != arguments.size())
+        return nullptr;
+
+    // Every call site gets its own hidden variables, so that f(1, f(2, 3)) does not
+    // overwrite the arguments of the outer call while evaluating the inner one.
+    std::vector<std::string> params;
+    std::string prefix = variable->name() + "#" + std::to_string(inline_sites_) + ".";
+    for (const auto& param : function.params()) {
+        params.push_back(prefix + param);
+        inline_parameters_[param] = params.back();
+    }
+    inline_budget_ = kMaxInlineNodes;
+    ASTPtr body = expression->inline_copy(*this);
+    inline_parameters_.clear();
+    if (!body)
+        return nullptr;
+    ++inline_sites_;
+    return make<InlineCallNode>(std::move(callee), std::move(arguments), function.info().id_, std::move(params),
+                                std::move(body));
+}
+
+
+const std::string* Optimizer::inline_parameter(const std::string& name) const {
+    auto it = inline_parameters_.find(name);
+    return it == inline_parameters_.end() ? nullptr : &it->second;
+}
+
+
+void Optimizer::optimize(ASTPtr& node) {
+    if (ASTPtr replacement = node->optimize(*this)) {
+        replacement->line_ = node->line_;
+        node = std::move(replacement);
+    }
+}
+
+
+ASTPtr NumberNode::optimize(Optimizer& optimizer) {
+    return nullptr;
+}
+
+ASTPtr NumberNode::inline_copy(Optimizer& optimizer) const {
+    return optimizer.make_inline<NumberNode>(value_.as_number());
+}
+
+
+ASTPtr NilNode::optimize(Optimizer& optimizer) {
+    return nullptr;
+}
+
+ASTPtr NilNode::inline_copy(Optimizer& optimizer) const {
+    return optimizer.make_inline<NilNode>();
+}
+
+
+ASTPtr StringNode::optimize(Optimizer& optimizer) {
+    return nullptr;
+}
+
+ASTPtr StringNode::inline_copy(Optimizer& optimizer) const {
+    return optimizer.make_inline<StringNode>(value_);
+}
+
+
+ASTPtr ConstantNode::optimize(Optimizer& optimizer) {
+    return nullptr;
+}
+
+ASTPtr ConstantNode::inline_copy(Optimizer& optimizer) const {
+    return optimizer.make_inline<ConstantNode>(value_);
+}
+
+
+ASTPtr AssignmentNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(expr_);
+    optimizer.note_assignment(binding_.name_, dynamic_cast<const FunctionNode*>(expr_.get()));
+
+    auto* update = dynamic_cast<BinaryOpNode*>(expr_.get());
+    if (!update || (update->op() != TokenType::plus_ && update->op() != TokenType::minus_))
+        return nullptr;
+    auto* target = dynamic_cast<const VariableNode*>(&update->left());
+    if (!target || target->name() != binding_.name_)
+        return nullptr;
+    auto step = update->right().constant();
+    if (!step)
+        return nullptr;
+    return optimizer.make<IncrementNode>(binding_.name_, update->op(), std::move(*step));
+}
+
+
+ASTPtr IncrementNode::optimize(Optimizer& optimizer) {
+    return nullptr;
+}
+
+
+ASTPtr BinaryOpNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(left_);
+    optimizer.optimize(right_);
+    auto lhs = left_->constant();
+    auto rhs = right_->constant();
+    if (!lhs || !rhs || too_large_to_fold(op_, *lhs, *rhs))
+        return nullptr;
+    try {
+        return optimizer.make<ConstantNode>(apply(op_, *lhs, *rhs));
+    } catch (std::exception&) {
+        return nullptr;
+    }
+}
+
+ASTPtr BinaryOpNode::inline_copy(Optimizer& optimizer) const {
+    ASTPtr left = left_->inline_copy(optimizer);
+    ASTPtr right = left ? right_->inline_copy(optimizer) : nullptr;
+    if (!right)
+        return nullptr;
+    return optimizer.make_inline<BinaryOpNode>(op_, std::move(left), std::move(right));
+}
+
+
+// A constant left operand that decides the result drops the right one, as execution would.
+ASTPtr LogicalOpNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(left_);
+    optimizer.optimize(right_);
+    auto lhs = left_->constant();
+    if (!lhs)
+        return nullptr;
+    if (lhs->to_bool() == (op_ == TokenType::or_))
+        return optimizer.make<ConstantNode>(Value(lhs->to_bool()));
+    if (auto rhs = right_->constant())
+        return optimizer.make<ConstantNode>(Value(rhs->to_bool()));
+    return nullptr;
+}
+
+ASTPtr LogicalOpNode::inline_copy(Optimizer& optimizer) const {
+    ASTPtr left = left_->inline_copy(optimizer);
+    ASTPtr right = left ? right_->inline_copy(optimizer) : nullptr;
+    if (!right)
+        return nullptr;
+    return optimizer.make_inline<LogicalOpNode>(op_, std::move(left), std::move(right));
+}
+
+
+ASTPtr UnaryOpNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(obj_);
+    auto value = obj_->constant();
+    if (!value)
+        return nullptr;
+    try {
+        return optimizer.make<ConstantNode>(apply(op_, *value));
+    } catch (std::exception&) {
+        return nullptr;
+    }
+}
+
+ASTPtr UnaryOpNode::inline_copy(Optimizer& optimizer) const {
+    ASTPtr obj = obj_->inline_copy(optimizer);
+    if (!obj)
+        return nullptr;
+    return optimizer.make_inline<UnaryOpNode>(op_, std::move(obj));
+}
+
+
+ASTPtr VariableNode::optimize(Optimizer& optimizer) {
+    return nullptr;
+}
+
+// Any other name could mean a different variable at the call site.
+ASTPtr VariableNode::inline_copy(Optimizer& optimizer) const {
+    const std::string* param = optimizer.inline_parameter(binding_.name_);
+    if (!param)
+        return nullptr;
+    return optimizer.make_inline<VariableNode>(*param);
+}
+
+
+// The branch that never runs is dropped before it is optimized.
+ASTPtr IfNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(condition_);
+    auto condition = condition_->constant();
+    if (!condition) {
+        optimizer.optimize(then_block_);
+        if (else_block_)
+            optimizer.optimize(else_block_);
+        return nullptr;
+    }
+    if (condition->is_true()) {
+        optimizer.optimize(then_block_);
+        return std::move(then_block_);
+    }
+    if (else_block_) {
+        optimizer.optimize(else_block_);
+        return std::move(else_block_);
+    }
+    return optimizer.make<NilNode>();
+}
+
+
+ASTPtr FunctionNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(body_);
+    return nullptr;
+}
+
+const ASTNode* FunctionNode::single_expression() const {
+    auto* block = dynamic_cast<const BlockNode*>(body_.get());
+    if (!block || block->commands().size() != 1)
+        return nullptr;
+    const ASTNode* command = block->commands().front().get();
+    if (auto* ret = dynamic_cast<const ReturnNode*>(command))
+        return &ret->expr();
+    return command;
+}
+
+
+ASTPtr ReturnNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(expr_);
+    return nullptr;
+}
+
+
+ASTPtr BlockNode::optimize(Optimizer& optimizer) {
+    for (auto& com : commands_) {
+        optimizer.optimize(com);
+    }
+    return nullptr;
+}
+
+
+ASTPtr PrintNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(expr_);
+    return nullptr;
+}
+
+
+ASTPtr CallNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(function_);
+    for (auto& arg : arguments_) {
+        optimizer.optimize(arg);
+    }
+    return optimizer.inline_call(function_, arguments_);
+}
+
+
+ASTPtr InlineCallNode::optimize(Optimizer& optimizer) {
+    return nullptr;
+}
+
+
+ASTPtr WhileNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(condition_);
+    auto condition = condition_->constant();
+    if (condition && !condition->is_true())
+        return optimizer.make<NilNode>();
+    optimizer.optimize(body_);
+    return nullptr;
+}
+
+
+ASTPtr ContinueNode::optimize(Optimizer& optimizer) {
+    return nullptr;
+}
+
+
+ASTPtr ForNode::optimize(Optimizer& optimizer) {
+    optimizer.note_assignment(var_binding_.name_, nullptr);
+    optimizer.optimize(range_);
+    optimizer.optimize(body_);
+    return nullptr;
+}
+
+
+ASTPtr BreakNode::optimize(Optimizer& optimizer) {
+    return nullptr;
+}
+
+
+ASTPtr ListNode::optimize(Optimizer& optimizer) {
+    for (auto& element : elements_) {
+        optimizer.optimize(element);
+    }
+    return nullptr;
+}
+
+
+ASTPtr DictNode::optimize(Optimizer& optimizer) {
+    for (auto& [key, value] : entries_) {
+        optimizer.optimize(key);
+        optimizer.optimize(value);
+    }
+    return nullptr;
+}
+
+
+ASTPtr IndexNode::optimize(Optimizer& optimizer) {
+    optimizer.optimize(target_);
+    if (idx_)
+        optimizer.optimize(idx_);
+    if (end_idx_)
+        optimizer.optimize(end_idx_);
+    return nullptr;
+}
+
+ASTPtr IndexNode::inline_copy(Optimizer& optimizer) const {
+    ASTPtr target = target_->inline_copy(optimizer);
+    ASTPtr idx = idx_ && target ? idx_->inline_copy(optimizer) : nullptr;
+    ASTPtr end_idx = end_idx_ && target ? end_idx_->inline_copy(optimizer) : nullptr;
+    if (!target || (idx_ && !idx) || (end_idx_ && !end_idx))
+        return nullptr;
+    return optimizer.make_inline<IndexNode>(std::move(target), std::move(idx), std::move(end_idx));
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.h"
+
+
+// Rewrites the parsed program before it is resolved and run (-O1): folds constant
+// subexpressions, drops if branches and while loops whose condition is a constant,
+// and turns `x += c` / `x -= c` into an IncrementNode that updates x in place.
+// Expressions that would fail at run time are left alone, so errors still happen
+// at the same point of execution.
+//
+// A second pass inlines calls of small functions: a variable assigned only once in the
+// whole program, to a function literal whose body is a single expression over its
+// parameters, such as `sq = function(x) return x * x end function`. Such a body has no
+// calls, so it is never recursive. The InlineCallNode still checks the callee at run time,
+// since the name may be shadowed by a parameter or called before the assignment.
+class Optimizer {
+    ASTArena& arena_;
+    bool inline_calls_;
+public:
+    // Longer strings and lists are built at run time rather than folded.
+    static constexpr double kMaxFoldedSize = 4096;
+    // Inlined bodies have at most this many nodes.
+    static constexpr int kMaxInlineNodes = 24;
+
+    // Replacement nodes are allocated in the arena of the program. Without inline_calls
+    // every call stays a call, as the profiler needs to see them.
+    Optimizer(ASTArena& arena, bool inline_calls = true) : arena_(arena), inline_calls_(inline_calls) {}
+
+    template <typename T, typename... Args>
+    ASTPtr make(Args&&... args) {
+        return arena_.make<T>(std::forward<Args>(args)...);
+    }
+
+    // Runs both passes.
+    void optimize_program(ASTPtr& program);
+    // Optimizes node in place, replacing it if the node asks for it.
+    void optimize(ASTPtr& node);
+
+    // Used by ASTNode::optimize. function is the value assigned, if it is a function literal.
+    void note_assignment(const std::string& name, const FunctionNode* function);
+    // The inlined form of a call, or nullptr.
+    ASTPtr inline_call(ASTPtr& callee, std::vector<ASTPtr>& arguments);
+
+    // Used by ASTNode::inline_copy: a node of the copy, or nullptr once the copy grows too large.
+    template <typename T, typename... Args>
+    ASTPtr make_inline(Args&&... args) {
+        if (--inline_budget_ < 0)
+            return nullptr;
+        return make<T>(std::forward<Args>(args)...);
+    }
+    // The hidden variable that replaces parameter name, or nullptr for any other name.
+    const std::string* inline_parameter(const std::string& name) const;
+
+private:
+    struct Assignments {
+        int count_ = 0;
+        const FunctionNode* function_ = nullptr;
+    };
+
+    bool inlining_ = false;
+    std::unordered_map<std::string, Assignments> assignments_;
+    size_t inline_sites_ = 0;
+    std::unordered_map<std::string, std::string> inline_parameters_;
+    int inline_budget_ = 0;
+};
@@ -0,0 +1,10 @@
+#include "output_buffer.h"
+
+
+void OutputBuffer::flush() {
+    if (buffer_.empty())
+        return;
+    stream_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    stream_.flush();
+    buffer_.clear();
+}
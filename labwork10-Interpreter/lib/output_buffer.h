@@ -0,0 +1,45 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <string_view>
+#include "value.h"
+
+
+// Script output on its way to the stream of the run. It is kept in memory and written in
+// blocks of kFlushSize, before the script reads input and when the run ends, so print
+// costs an append instead of a stream call.
+class OutputBuffer {
+public:
+    static constexpr size_t kFlushSize = 64 * 1024;
+
+    explicit OutputBuffer(std::ostream& stream) : stream_(stream) {
+        buffer_.reserve(kFlushSize + 256);
+    }
+    ~OutputBuffer() { flush(); }
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void print(const Value& value) {
+        value.append_to(buffer_);
+        flush_if_full();
+    }
+    void println(const Value& value) {
+        value.append_to(buffer_);
+        buffer_ += '\n';
+        flush_if_full();
+    }
+    void write(std::string_view str) {
+        buffer_ += str;
+        flush_if_full();
+    }
+    void flush();
+
+private:
+    std::ostream& stream_;
+    std::string buffer_;
+
+    void flush_if_full() {
+        if (buffer_.size() >= kFlushSize)
+            flush();
+    }
+};
@@ -1,7 +1,7 @@
 #include "parser.h"
 #include <iostream>
 
-Parser::Parser(Lexer& lexer) : lexer_(lexer) {
+Parser::Parser(Lexer& lexer, ASTArena& arena) : lexer_(lexer), arena_(arena) {
     next_token();
 }
 
@@ -17,7 +17,7 @@ void Parser::next_token() {
 
 void Parser::expect_token(TokenType expected) {
     if (token_ != expected) {
-        throw std::runtime_error("line: " + std::to_string(lexer_.get_line()) + "   unexpected token: " + lexeme_ + " but expected " + std::to_string(expected));
+        throw std::runtime_error("line: " + std::to_string(lexer_.get_line()) + "   unexpected token: " + std::string(lexeme_) + " but expected " + std::to_string(expected));
     }
     next_token();
 }
@@ -40,6 +40,7 @@ ASTPtr Parser::parse_block() {
             token_ == TokenType::end_for_) {
             break;
         }
+        uint32_t line = lexer_.get_line();
         switch (token_) {
         case TokenType::if_: commands.push_back(parse_if()); break;
         case TokenType::function_: commands.push_back(parse_function()); break;
@@ -48,7 +49,7 @@ ASTPtr Parser::parse_block() {
         case TokenType::while_: commands.push_back(parse_while()); break;
         case TokenType::for_: commands.push_back(parse_for()); break;
         case TokenType::identifier_: {
-            std::string name = lexeme_;
+            std::string_view name = lexeme_;
             next_token();
             if (token_ == TokenType::assign_ ||
                 token_ == TokenType::plus_assign_ ||
@@ -61,7 +62,9 @@ ASTPtr Parser::parse_block() {
                 next_token();
                 ASTPtr rhs = parse_expression();
                 if (op == TokenType::assign_) {
-                    commands.push_back(std::make_unique<AssignmentNode>(name, std::move(rhs)));
+                    if (auto* function = dynamic_cast<FunctionNode*>(rhs.get()); function)
+                        function->set_name(std::string(name));
+                    commands.push_back(arena_.make<AssignmentNode>(std::string(name), std::move(rhs)));
                 } else {
                     TokenType binop;
                     switch (op) {
@@ -72,9 +75,9 @@ ASTPtr Parser::parse_block() {
                         case TokenType::percent_assign_: binop = TokenType::percent_; break;
                         case TokenType::pow_assign_: binop = TokenType::pow_; break;
                     }
-                    ASTPtr lhs = std::make_unique<VariableNode>(name);
-                    ASTPtr expr = std::make_unique<BinaryOpNode>(binop, std::move(lhs), std::move(rhs));
-                    commands.push_back(std::make_unique<AssignmentNode>(name, std::move(expr)));
+                    ASTPtr lhs = arena_.make<VariableNode>(std::string(name));
+                    ASTPtr expr = arena_.make<BinaryOpNode>(binop, std::move(lhs), std::move(rhs));
+                    commands.push_back(arena_.make<AssignmentNode>(std::string(name), std::move(expr)));
                 }
             } else {
                 ASTPtr expr = parse_call_from(name);
@@ -85,25 +88,26 @@ ASTPtr Parser::parse_block() {
         case TokenType::return_: {
             next_token();                           
             ASTPtr expr = parse_expression();
-            commands.push_back(std::make_unique<ReturnNode>(std::move(expr)));
+            commands.push_back(arena_.make<ReturnNode>(std::move(expr)));
             break;
         }
         case TokenType::break_: {
             next_token();
-            commands.push_back(std::make_unique<BreakNode>());
+            commands.push_back(arena_.make<BreakNode>());
             break;
         }
         case TokenType::continue_: {
             next_token();
-            commands.push_back(std::make_unique<ContinueNode>());
+            commands.push_back(arena_.make<ContinueNode>());
             break;
         }
         default:
             commands.push_back(parse_expression());
             break;
         }
+        commands.back()->line_ = line;
     }
-    return std::make_unique<BlockNode>(std::move(commands));
+    return arena_.make<BlockNode>(std::move(commands));
 }
 
 
@@ -112,7 +116,7 @@ ASTPtr Parser::parse_expression() {
     while (token_ == TokenType::or_) {
         next_token();
         ASTPtr rhs = parse_and();
-        lhs = std::make_unique<BinaryOpNode>(TokenType::or_, std::move(lhs), std::move(rhs));
+        lhs = arena_.make<LogicalOpNode>(TokenType::or_, std::move(lhs), std::move(rhs));
     }
     return lhs;
 }
@@ -123,7 +127,7 @@ ASTPtr Parser::parse_and() {
     while (token_ == TokenType::and_) {
         next_token();
         ASTPtr rhs = parse_comparison();
-        lhs = std::make_unique<BinaryOpNode>(TokenType::and_, std::move(lhs), std::move(rhs));
+        lhs = arena_.make<LogicalOpNode>(TokenType::and_, std::move(lhs), std::move(rhs));
     }
     return lhs;
 }
@@ -137,7 +141,7 @@ ASTPtr Parser::parse_comparison() {
         TokenType op = token_;
         next_token();
         ASTPtr rhs = parse_add_sub();
-        lhs = std::make_unique<BinaryOpNode>(op, std::move(lhs), std::move(rhs));
+        lhs = arena_.make<BinaryOpNode>(op, std::move(lhs), std::move(rhs));
     }
     return lhs;
 }
@@ -149,7 +153,7 @@ ASTPtr Parser:: parse_add_sub() {
         TokenType op = token_;
         next_token();
         ASTPtr rhs = parse_mul_div();
-        lhs = std::make_unique<BinaryOpNode>(op, std::move(lhs), std::move(rhs));
+        lhs = arena_.make<BinaryOpNode>(op, std::move(lhs), std::move(rhs));
     }
     return lhs;
 }
@@ -161,7 +165,7 @@ ASTPtr Parser::parse_mul_div() {
         TokenType op = token_;
         next_token();
         ASTPtr rhs = parse_pow();
-        lhs = std::make_unique<BinaryOpNode>(op, std::move(lhs), std::move(rhs));
+        lhs = arena_.make<BinaryOpNode>(op, std::move(lhs), std::move(rhs));
     }
     return lhs;
 }
@@ -172,7 +176,7 @@ ASTPtr Parser::parse_pow() {
     if (token_ == TokenType::pow_) {
         next_token();
         ASTPtr rhs = parse_pow();
-        lhs = std::make_unique<BinaryOpNode>(TokenType::pow_, std::move(lhs), std::move(rhs));
+        lhs = arena_.make<BinaryOpNode>(TokenType::pow_, std::move(lhs), std::move(rhs));
     }
     return lhs;
 }
@@ -185,7 +189,7 @@ ASTPtr Parser::parse_unary() {
         TokenType op = token_;
         next_token();
         ASTPtr operand = parse_unary();
-        return std::make_unique<UnaryOpNode>(op, std::move(operand));
+        return arena_.make<UnaryOpNode>(op, std::move(operand));
     }
     return parse_call_access();
 }
@@ -205,7 +209,7 @@ ASTPtr Parser::parse_call_access() {
                 }
             }
             expect_token(TokenType::r_paren_);
-            expr = std::make_unique<CallNode>(std::move(expr), std::move(args));
+            expr = arena_.make<CallNode>(std::move(expr), std::move(args));
         } else if (token_ == TokenType::l_bracket_) {
             next_token();
             ASTPtr idx = nullptr;
@@ -220,7 +224,7 @@ ASTPtr Parser::parse_call_access() {
             }
 
             expect_token(TokenType::r_bracket_);
-            expr = std::make_unique<IndexNode>(std::move(expr), std::move(idx), std::move(end_idx));
+            expr = arena_.make<IndexNode>(std::move(expr), std::move(idx), std::move(end_idx));
         } else {
             break;
         }
@@ -233,25 +237,25 @@ ASTPtr Parser::parse_unit() {
     switch (token_) {
         case TokenType::true_: {
             next_token();
-            return std::make_unique<NumberNode>(1.0);
+            return arena_.make<NumberNode>(1.0);
         }
         case TokenType::false_: {
             next_token();
-            return std::make_unique<NumberNode>(0.0);
+            return arena_.make<NumberNode>(0.0);
         }
         case TokenType::nil_: {
             next_token();
-            return std::make_unique<NilNode>();
+            return arena_.make<NilNode>();
         }        
         case TokenType::number_: {
             double val = number_;
             next_token();
-            return std::make_unique<NumberNode>(val);
+            return arena_.make<NumberNode>(val);
         }
         case TokenType::string_: {
-            std::string val = lexeme_;
+            std::string val(lexeme_);
             next_token();
-            return std::make_unique<StringNode>(val);
+            return arena_.make<StringNode>(std::move(val));
         }
         case TokenType::identifier_: {
             return parse_variable();
@@ -277,16 +281,31 @@ ASTPtr Parser::parse_unit() {
                 }
             }
             expect_token(TokenType::r_bracket_);
-            return std::make_unique<ListNode>(std::move(elems));
+            return arena_.make<ListNode>(std::move(elems));
+        }
+        case TokenType::l_brace_: {
+            next_token();
+            std::vector<std::pair<ASTPtr, ASTPtr>> entries;
+            while (token_ != TokenType::r_brace_) {
+                ASTPtr key = parse_expression();
+                expect_token(TokenType::colon_);
+                ASTPtr value = parse_expression();
+                entries.emplace_back(std::move(key), std::move(value));
+                if (token_ != TokenType::comma_)
+                    break;
+                next_token();
+            }
+            expect_token(TokenType::r_brace_);
+            return arena_.make<DictNode>(std::move(entries));
         }
         default:
-            throw std::runtime_error("line: " + std::to_string(lexer_.get_line()) + "   value was expected, got " + lexeme_);
+            throw std::runtime_error("line: " + std::to_string(lexer_.get_line()) + "   value was expected, got " + std::string(lexeme_));
     }
 }
 
 
-ASTPtr Parser::parse_call_from(const std::string& name) {
-    ASTPtr expr = std::make_unique<VariableNode>(name);
+ASTPtr Parser::parse_call_from(std::string_view name) {
+    ASTPtr expr = arena_.make<VariableNode>(std::string(name));
     while (token_ == TokenType::l_paren_) {
         next_token();
         std::vector<ASTPtr> args;
@@ -296,7 +315,7 @@ ASTPtr Parser::parse_call_from(const std::string& name) {
             } while (token_ == TokenType::comma_ && (next_token(), true));
         }
         expect_token(TokenType::r_paren_);
-        expr = std::make_unique<CallNode>(std::move(expr), std::move(args));
+        expr = arena_.make<CallNode>(std::move(expr), std::move(args));
     }
     return expr;
 }
@@ -307,14 +326,14 @@ ASTPtr Parser::parse_print(bool is_ln) {
     expect_token(TokenType::l_paren_);
     ASTPtr expr = parse_expression();
     expect_token(TokenType::r_paren_);
-    return(std::make_unique<PrintNode>(std::move(expr), is_ln));
+    return(arena_.make<PrintNode>(std::move(expr), is_ln));
 }
 
 
 ASTPtr Parser::parse_variable() {
-    std::string name = lexeme_;
+    std::string_view name = lexeme_;
     next_token();
-    return std::make_unique<VariableNode>(name);
+    return arena_.make<VariableNode>(std::string(name));
 }
 
 
@@ -333,18 +352,19 @@ ASTPtr Parser::parse_if() {
     } else {
         expect_token(TokenType::end_if_);
     }
-    return std::make_unique<IfNode>(std::move(cond), std::move(then_block), std::move(else_block));
+    return arena_.make<IfNode>(std::move(cond), std::move(then_block), std::move(else_block));
 }
 
 
 ASTPtr Parser::parse_function() {
+    uint32_t line = lexer_.get_line();
     expect_token(TokenType::function_);
     expect_token(TokenType::l_paren_);
     
     std::vector<std::string> params;
     if (token_ != TokenType::r_paren_) {
         do {
-            params.push_back(lexeme_);
+            params.emplace_back(lexeme_);
             expect_token(TokenType::identifier_);
         } while (token_ == TokenType::comma_ && (next_token(), true));
     }
@@ -353,7 +373,7 @@ ASTPtr Parser::parse_function() {
     ASTPtr body = parse_block();
     expect_token(TokenType::end_function_);
     
-    return std::make_unique<FunctionNode>(std::move(params), std::move(body));
+    return arena_.make<FunctionNode>(std::move(params), std::move(body), FunctionInfo{"", line, ++function_count_});
 }
 
 
@@ -362,17 +382,17 @@ ASTPtr Parser::parse_while() {
     ASTPtr cond = parse_expression(); 
     ASTPtr body = parse_block();
     expect_token(TokenType::end_while_);
-    return std::make_unique<WhileNode>(std::move(cond), std::move(body));
+    return arena_.make<WhileNode>(std::move(cond), std::move(body));
 }
 
 
 ASTPtr Parser::parse_for() {
     expect_token(TokenType::for_);
-    std::string var_name = lexeme_;
+    std::string_view var_name = lexeme_;
     expect_token(TokenType::identifier_);
     expect_token(TokenType::in_);
     ASTPtr range = parse_expression();
     ASTPtr body = parse_block();
     expect_token(TokenType::end_for_);
-    return std::make_unique<ForNode>(var_name, std::move(range), std::move(body));
+    return arena_.make<ForNode>(std::string(var_name), std::move(range), std::move(body));
 }
\ No newline at end of file
@@ -3,18 +3,20 @@
 #include "ast.h"
 #include <stdexcept>
 #include <memory>
-
-using ASTPtr = std::unique_ptr<ASTNode>;
+#include <string_view>
 
 class Parser {
 public:
-    Parser(Lexer& lexer);
+    // Nodes are allocated in arena; lexemes are borrowed from the lexer's source buffer.
+    Parser(Lexer& lexer, ASTArena& arena);
     ASTPtr parse();
 
 private:
     Lexer& lexer_;
+    ASTArena& arena_;
+    uint32_t function_count_ = 0;
     TokenType token_;
-    std::string lexeme_;
+    std::string_view lexeme_;
     double number_;
 
 
@@ -31,7 +33,7 @@ private:
     ASTPtr parse_variable();
     ASTPtr parse_if();
     ASTPtr parse_function();
-    ASTPtr parse_call_from(const std::string& name);
+    ASTPtr parse_call_from(std::string_view name);
     ASTPtr parse_print(bool is_ln);
     ASTPtr parse_comparison(); 
     ASTPtr parse_while();
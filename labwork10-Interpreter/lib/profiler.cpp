@@ -0,0 +1,149 @@
+#include "profiler.h"
+#include "heap.h"
+#include <algorithm>
+#include <iomanip>
+#include <type_traits>
+
+
+std::string FunctionInfo::label() const {
+    return (name_.empty() ? "<anonymous>" : name_) + ":" + std::to_string(line_);
+}
+
+
+void Profiler::start() {
+    functions_.clear();
+    lines_.clear();
+    function_report_.clear();
+    nodes_ = {{0, main_.name_}};
+    children_.clear();
+    frames_.clear();
+    Stats* stats = &functions_[&main_];
+    ++stats->count_;
+    ++stats->active_;
+    last_ = Clock::now();
+    last_allocations_ = CycleCollector::stats().allocations_;
+    frames_.push_back({&main_, stats, 0, &lines_[0], 0, last_});
+}
+
+
+void Profiler::stop() {
+    while (frames_.size() > 1)
+        leave();
+    charge();
+    Frame& frame = frames_.back();
+    frame.function_stats_->total_ += last_ - frame.entered_;
+    --frame.function_stats_->active_;
+
+    for (const auto& [function, stats] : functions_)
+        function_report_.emplace_back(function == &main_ ? main_.name_ : function->label(), stats);
+    functions_.clear();
+}
+
+
+void Profiler::switch_line(uint32_t line) {
+    charge();
+    Frame& frame = frames_.back();
+    frame.line_ = line;
+    frame.line_stats_ = &lines_[line];
+    ++frame.line_stats_->count_;
+}
+
+
+void Profiler::enter(const FunctionInfo* function) {
+    charge();
+    Stats* stats = &functions_[function];
+    ++stats->count_;
+    ++stats->active_;
+
+    auto [it, inserted] = children_.try_emplace({frames_.back().node_, function}, nodes_.size());
+    if (inserted)
+        nodes_.push_back({frames_.back().node_, function->label()});
+    frames_.push_back({function, stats, 0, &lines_[0], it->second, last_});
+}
+
+
+void Profiler::leave() {
+    charge();
+    Frame& frame = frames_.back();
+    if (--frame.function_stats_->active_ == 0)
+        frame.function_stats_->total_ += last_ - frame.entered_;
+    frames_.pop_back();
+}
+
+
+void Profiler::charge() {
+    Clock::time_point now = Clock::now();
+    uint64_t allocations = CycleCollector::stats().allocations_;
+    Clock::duration elapsed = now - last_;
+    Frame& frame = frames_.back();
+    frame.function_stats_->self_ += elapsed;
+    frame.function_stats_->allocations_ += allocations - last_allocations_;
+    frame.line_stats_->self_ += elapsed;
+    frame.line_stats_->allocations_ += allocations - last_allocations_;
+    nodes_[frame.node_].self_ += elapsed;
+    last_ = now;
+    last_allocations_ = allocations;
+}
+
+
+namespace {
+
+double to_ms(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+template <typename Map>
+auto by_self_time(const Map& stats) {
+    using Key = std::remove_const_t<typename Map::value_type::first_type>;
+    using Stats = typename Map::value_type::second_type;
+    std::vector<std::pair<Key, const Stats*>> sorted;
+    for (const auto& [key, value] : stats)
+        sorted.emplace_back(key, &value);
+    std::sort(sorted.begin(), sorted.end(), [](const auto& l, const auto& r) {
+        return l.second->self_ > r.second->self_;
+    });
+    return sorted;
+}
+
+}  // namespace
+
+
+void Profiler::report(std::ostream& out) const {
+    auto flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+
+    out << std::left << std::setw(32) << "function" << std::right << std::setw(10) << "calls"
+        << std::setw(12) << "total ms" << std::setw(12) << "self ms" << std::setw(12) << "allocs" << "\n";
+    for (const auto& [function, stats] : by_self_time(function_report_)) {
+        out << std::left << std::setw(32) << function << std::right << std::setw(10) << stats->count_
+            << std::setw(12) << to_ms(stats->total_) << std::setw(12) << to_ms(stats->self_)
+            << std::setw(12) << stats->allocations_ << "\n";
+    }
+
+    out << "\n" << std::left << std::setw(32) << "line" << std::right << std::setw(10) << "hits"
+        << std::setw(12) << "" << std::setw(12) << "self ms" << std::setw(12) << "allocs" << "\n";
+    for (const auto& [line, stats] : by_self_time(lines_)) {
+        if (line == 0)      // a call before its first statement
+            continue;
+        out << std::left << std::setw(32) << line << std::right << std::setw(10) << stats->count_
+            << std::setw(12) << "" << std::setw(12) << to_ms(stats->self_)
+            << std::setw(12) << stats->allocations_ << "\n";
+    }
+    out.flags(flags);
+}
+
+
+void Profiler::write_folded(std::ostream& out) const {
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(nodes_[i].self_).count();
+        if (us == 0)
+            continue;
+        std::vector<const std::string*> path;
+        for (size_t node = i; node != 0; node = nodes_[node].parent_)
+            path.push_back(&nodes_[node].label_);
+        path.push_back(&nodes_[0].label_);
+        for (auto it = path.rbegin(); it != path.rend(); ++it)
+            out << **it << (it + 1 == path.rend() ? " " : ";");
+        out << us << "\n";
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+// A user function as written in the script. The profiler tells functions apart by the
+// address of their FunctionInfo, which the AST node and the compiled prototype own.
+struct FunctionInfo {
+    std::string name_;      // the variable the function was first assigned to, if any
+    uint32_t line_ = 0;
+    uint32_t id_ = 0;       // distinct for every function literal of a program; checked by inlined calls
+
+    std::string label() const;
+};
+
+// Instrumented profiler. While it is attached to a run, the engines report every change of
+// the current source line and every call and return of a user function; the time and the
+// heap allocations since the previous report are charged to the line, the function and the
+// call stack that were current. Detached, it costs the engines nothing but a null check.
+class Profiler {
+public:
+    void start();
+    void stop();
+
+    void line(uint32_t line) {
+        if (line != frames_.back().line_)
+            switch_line(line);
+    }
+    void enter(const FunctionInfo* function);
+    void leave();
+
+    // Functions and lines, by exclusive time. Both are available after stop().
+    void report(std::ostream& out) const;
+    // One line per call stack with its exclusive time in microseconds,
+    // "<main>;f:3;g:10 1234", the input format of flamegraph.pl and speedscope.
+    void write_folded(std::ostream& out) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t count_ = 0;            // calls of a function, executions of a line
+        Clock::duration self_{};
+        Clock::duration total_{};       // functions only: time until the outermost call returns
+        uint64_t allocations_ = 0;
+        uint32_t active_ = 0;           // functions only: calls in progress
+    };
+
+    struct Frame {
+        const FunctionInfo* function_;
+        Stats* function_stats_;
+        uint32_t line_;
+        Stats* line_stats_;
+        size_t node_;
+        Clock::time_point entered_;
+    };
+
+    struct StackNode {
+        size_t parent_;
+        std::string label_;
+        Clock::duration self_{};
+    };
+
+    FunctionInfo main_{"<main>", 0};
+    std::unordered_map<const FunctionInfo*, Stats> functions_;
+    // functions_ by label, filled by stop(): the FunctionInfos go away with the program.
+    std::vector<std::pair<std::string, Stats>> function_report_;
+    std::unordered_map<uint32_t, Stats> lines_;
+    std::vector<StackNode> nodes_;
+    std::map<std::pair<size_t, const FunctionInfo*>, size_t> children_;
+    std::vector<Frame> frames_;
+    Clock::time_point last_;
+    uint64_t last_allocations_ = 0;
+
+    void switch_line(uint32_t line);
+    // Charges the time and allocations since the last event to the current frame.
+    void charge();
+};
@@ -0,0 +1,214 @@
+#include "resolver.h"
+#include "std_lib.h"
+
+
+Resolver::Resolver() {
+    scopes_.push_back(std::make_unique<Scope>());
+    global_ = scopes_.back().get();
+    global_->parent_ = nullptr;
+    current_ = global_;
+    for (const auto& func : get_stdlib_functions()) {
+        declare(std::string(func.name_));
+    }
+}
+
+
+void Resolver::resolve_program(ASTNode& program) {
+    program.resolve(*this);
+
+    for (const auto& ref : references_) {
+        Binding& binding = *ref.binding_;
+        binding.candidates_.clear();
+        uint32_t depth = 0;
+        for (Scope* scope = ref.scope_; scope; scope = scope->parent_, ++depth) {
+            auto it = scope->slots_.find(binding.name_);
+            if (it != scope->slots_.end())
+                binding.candidates_.push_back({depth, it->second});
+        }
+    }
+    references_.clear();
+}
+
+
+const std::vector<std::string>& Resolver::global_names() const {
+    return global_->names_;
+}
+
+
+uint32_t Resolver::declare(const std::string& name) {
+    auto it = current_->slots_.find(name);
+    if (it != current_->slots_.end())
+        return it->second;
+    uint32_t slot = static_cast<uint32_t>(current_->names_.size());
+    current_->slots_.emplace(name, slot);
+    current_->names_.push_back(name);
+    return slot;
+}
+
+
+void Resolver::reference(Binding& binding) {
+    references_.push_back({&binding, current_});
+}
+
+
+void Resolver::begin_function(const std::vector<std::string>& params) {
+    // The new function is a closure over the enclosing scope.
+    current_->captured_ = true;
+    scopes_.push_back(std::make_unique<Scope>());
+    scopes_.back()->parent_ = current_;
+    current_ = scopes_.back().get();
+    for (const auto& param : params) {
+        current_->slots_[param] = static_cast<uint32_t>(current_->names_.size());
+        current_->names_.push_back(param);
+    }
+}
+
+
+FrameLayout Resolver::end_function() {
+    FrameLayout layout{current_->names_.size(), current_->captured_};
+    current_ = current_->parent_;
+    return layout;
+}
+
+
+void NumberNode::resolve(Resolver& resolver) {}
+
+
+void NilNode::resolve(Resolver& resolver) {}
+
+
+void StringNode::resolve(Resolver& resolver) {}
+
+
+void ConstantNode::resolve(Resolver& resolver) {}
+
+
+void IncrementNode::resolve(Resolver& resolver) {
+    resolver.reference(binding_);
+}
+
+
+void AssignmentNode::resolve(Resolver& resolver) {
+    expr_->resolve(resolver);
+    binding_.local_slot_ = resolver.declare(binding_.name_);
+    resolver.reference(binding_);
+}
+
+
+void BinaryOpNode::resolve(Resolver& resolver) {
+    left_->resolve(resolver);
+    right_->resolve(resolver);
+}
+
+
+void LogicalOpNode::resolve(Resolver& resolver) {
+    left_->resolve(resolver);
+    right_->resolve(resolver);
+}
+
+
+void UnaryOpNode::resolve(Resolver& resolver) {
+    obj_->resolve(resolver);
+}
+
+
+void VariableNode::resolve(Resolver& resolver) {
+    resolver.reference(binding_);
+}
+
+
+void IfNode::resolve(Resolver& resolver) {
+    condition_->resolve(resolver);
+    then_block_->resolve(resolver);
+    if (else_block_)
+        else_block_->resolve(resolver);
+}
+
+
+void FunctionNode::resolve(Resolver& resolver) {
+    resolver.begin_function(params_);
+    body_->resolve(resolver);
+    frame_ = resolver.end_function();
+}
+
+
+void ReturnNode::resolve(Resolver& resolver) {
+    expr_->resolve(resolver);
+}
+
+
+void BlockNode::resolve(Resolver& resolver) {
+    for (auto& com : commands_) {
+        com->resolve(resolver);
+    }
+}
+
+
+void PrintNode::resolve(Resolver& resolver) {
+    expr_->resolve(resolver);
+}
+
+
+void CallNode::resolve(Resolver& resolver) {
+    function_->resolve(resolver);
+    for (auto& arg : arguments_) {
+        arg->resolve(resolver);
+    }
+}
+
+
+void InlineCallNode::resolve(Resolver& resolver) {
+    function_->resolve(resolver);
+    for (auto& arg : arguments_) {
+        arg->resolve(resolver);
+    }
+    for (auto& param : params_) {
+        param.local_slot_ = resolver.declare(param.name_);
+        resolver.reference(param);
+    }
+    body_->resolve(resolver);
+}
+
+
+void WhileNode::resolve(Resolver& resolver) {
+    condition_->resolve(resolver);
+    body_->resolve(resolver);
+}
+
+
+void ContinueNode::resolve(Resolver& resolver) {}
+
+
+void ForNode::resolve(Resolver& resolver) {
+    range_->resolve(resolver);
+    var_binding_.local_slot_ = resolver.declare(var_binding_.name_);
+    resolver.reference(var_binding_);
+    body_->resolve(resolver);
+}
+
+
+void BreakNode::resolve(Resolver& resolver) {}
+
+
+void ListNode::resolve(Resolver& resolver) {
+    for (auto& element : elements_) {
+        element->resolve(resolver);
+    }
+}
+
+
+void DictNode::resolve(Resolver& resolver) {
+    for (auto& [key, value] : entries_) {
+        key->resolve(resolver);
+        value->resolve(resolver);
+    }
+}
+
+
+void IndexNode::resolve(Resolver& resolver) {
+    target_->resolve(resolver);
+    if (idx_)
+        idx_->resolve(resolver);
+    if (end_idx_)
+        end_idx_->resolve(resolver);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "environment.h"
+#include "ast.h"
+
+
+// Binds every variable reference of a parsed program to frame slots.
+// Scopes are the program itself and every function literal; blocks do not open a scope.
+// Candidates are computed once the whole program has been seen, since an enclosing
+// scope may declare a name after the function that uses it.
+class Resolver {
+public:
+    Resolver();
+
+    void resolve_program(ASTNode& program);
+    const std::vector<std::string>& global_names() const;
+
+    // Used by ASTNode::resolve.
+    uint32_t declare(const std::string& name);
+    void reference(Binding& binding);
+    void begin_function(const std::vector<std::string>& params);
+    FrameLayout end_function();
+
+private:
+    struct Scope {
+        Scope* parent_;
+        std::unordered_map<std::string, uint32_t> slots_;
+        std::vector<std::string> names_;
+        bool captured_ = false;
+    };
+
+    struct Reference {
+        Binding* binding_;
+        Scope* scope_;
+    };
+
+    std::vector<std::unique_ptr<Scope>> scopes_;
+    Scope* global_;
+    Scope* current_;
+    std::vector<Reference> references_;
+};
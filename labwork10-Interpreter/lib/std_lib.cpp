@@ -1,209 +1,558 @@
 #include "std_lib.h"
 
 
-std::unordered_map<std::string, StdlibFunc>& get_stdlib_functions() {
-    static bool seeded = ([](){ std::srand(static_cast<unsigned>(std::time(nullptr))); return true; })();
-
-    static std::unordered_map<std::string, StdlibFunc> funcs = {
-        {"abs", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
-            double x = std::get<double>(a[0].get_data());
-            return Value(std::abs(x));
-        }},
-        {"ceil", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
-            double x = std::get<double>(a[0].get_data());
-            return Value(std::ceil(x));
-        }},
-        {"floor", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
-            double x = std::get<double>(a[0].get_data());
-            return Value(std::floor(x));
-        }},
-        {"round", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
-            double x = std::get<double>(a[0].get_data());
-            return Value(std::round(x));
-        }},
-        {"sqrt", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
-            double x = std::get<double>(a[0].get_data());
-            return x < 0 ? Value() : Value(std::sqrt(x));
-        }},
-        {"rnd", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
-            int n = static_cast<int>(std::get<double>(a[0].get_data()));
-            if (n <= 0) return Value();
-            return Value(static_cast<double>(std::rand() % n));
-        }},
-        {"parse_num", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::string) return Value();
-            auto str = std::get<std::string>(a[0].get_data());
-            char* endp = nullptr;
-            double x = std::strtod(str.c_str(), &endp);
-            if (endp == str.c_str() || *endp != '\0') return Value();
-            return Value(x);
-        }},
-        {"to_string", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
-            double x = std::get<double>(a[0].get_data());
-            long long int_x = static_cast<long long>(x);
-            if (std::fabs(x - int_x) < std::numeric_limits<double>::epsilon())
-                return Value(std::to_string(int_x));
-            else
-                return Value(std::to_string(x));
-        }},
+namespace {
 
-        {"len", [](auto& a) -> Value {
-            if (a.size() != 1) return Value();
-            if (a[0].type() == ValueType::string) {
-                return Value(static_cast<double>(std::get<std::string>(a[0].get_data()).size()));
-            }
-            if (a[0].type() == ValueType::list) {
-                return Value(static_cast<double>(std::get<List>(a[0].get_data())->size()));
+// Kernels over packed number lists. Reductions keep four independent accumulators so that
+// the compiler can vectorize them without reassociating a single sum (-ffast-math).
+double sum_numbers(std::span<const double> xs) {
+    double acc[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 4 <= xs.size(); i += 4) {
+        for (size_t lane = 0; lane < 4; ++lane)
+            acc[lane] += xs[i + lane];
+    }
+    double total = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    for (; i < xs.size(); ++i)
+        total += xs[i];
+    return total;
+}
+
+double dot_numbers(std::span<const double> xs, std::span<const double> ys) {
+    double acc[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 4 <= xs.size(); i += 4) {
+        for (size_t lane = 0; lane < 4; ++lane)
+            acc[lane] += xs[i + lane] * ys[i + lane];
+    }
+    double total = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    for (; i < xs.size(); ++i)
+        total += xs[i] * ys[i];
+    return total;
+}
+
+// xs must not be empty.
+template <typename Pick>
+double reduce_numbers(std::span<const double> xs, Pick pick) {
+    double acc[4] = {xs[0], xs[0], xs[0], xs[0]};
+    size_t i = 0;
+    for (; i + 4 <= xs.size(); i += 4) {
+        for (size_t lane = 0; lane < 4; ++lane)
+            acc[lane] = pick(acc[lane], xs[i + lane]);
+    }
+    double result = pick(pick(acc[0], acc[1]), pick(acc[2], acc[3]));
+    for (; i < xs.size(); ++i)
+        result = pick(result, xs[i]);
+    return result;
+}
+
+// min/max take either one list of numbers or the numbers themselves.
+template <typename Pick>
+Value pick_number(StdlibArgs a, Pick pick) {
+    if (a.size() == 1 && a[0].type() == ValueType::list) {
+        auto xs = a[0].as_list().numbers();
+        if (!xs || xs->empty()) return Value();
+        return Value(reduce_numbers(*xs, pick));
+    }
+    if (a.empty()) return Value();
+    double result = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].type() != ValueType::number) return Value();
+        result = i == 0 ? a[i].as_number() : pick(result, a[i].as_number());
+    }
+    return Value(result);
+}
+
+// list op list of the same length, or list op number.
+template <typename Op>
+Value elementwise(StdlibArgs a, Op op) {
+    if (a.size() != 2 || a[0].type() != ValueType::list) return Value();
+    auto xs = a[0].as_list().numbers();
+    if (!xs) return Value();
+    std::vector<double> out(xs->size());
+    if (a[1].type() == ValueType::number) {
+        double y = a[1].as_number();
+        for (size_t i = 0; i < out.size(); ++i)
+            out[i] = op((*xs)[i], y);
+    } else if (a[1].type() == ValueType::list) {
+        auto ys = a[1].as_list().numbers();
+        if (!ys || ys->size() != xs->size()) return Value();
+        for (size_t i = 0; i < out.size(); ++i)
+            out[i] = op((*xs)[i], (*ys)[i]);
+    } else {
+        return Value();
+    }
+    return Value(make_ref<ListObject>(std::move(out)));
+}
+
+// Lists at least this long are split between threads when sorting them needs no script calls.
+constexpr size_t kParallelSortThreshold = 1 << 16;
+
+// Elements past this one could not be indexed anyway.
+constexpr double kMaxRangeSize = std::numeric_limits<int>::max();
+
+// Sorts chunks on separate threads and merges them pairwise; less must not touch
+// reference counts or any other interpreter state.
+template <typename T, typename Less>
+void parallel_sort(std::span<T> xs, Less less) {
+    size_t workers = std::min<size_t>(std::thread::hardware_concurrency(), 8);
+    if (workers < 2 || xs.size() < kParallelSortThreshold) {
+        std::sort(xs.begin(), xs.end(), less);
+        return;
+    }
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= workers; ++i)
+        bounds.push_back(xs.size() * i / workers);
+    {
+        std::vector<std::jthread> threads;
+        for (size_t i = 0; i < workers; ++i) {
+            threads.emplace_back([&, i] {
+                std::sort(xs.begin() + bounds[i], xs.begin() + bounds[i + 1], less);
+            });
+        }
+    }
+    for (size_t width = 1; width < workers; width *= 2) {
+        for (size_t i = 0; i + width < workers; i += 2 * width) {
+            size_t end = bounds[std::min(i + 2 * width, workers)];
+            std::inplace_merge(xs.begin() + bounds[i], xs.begin() + bounds[i + width], xs.begin() + end, less);
+        }
+    }
+}
+
+// NaN is not ordered by <, so it is moved behind every other number first.
+void sort_numbers(std::span<double> xs) {
+    auto nan = std::partition(xs.begin(), xs.end(), [](double x) { return !std::isnan(x); });
+    parallel_sort(std::span<double>(xs.begin(), nan), std::less<>());
+}
+
+// Sorts pointers rather than the values, so the threads never copy a Value.
+void sort_strings(std::vector<Value>& items) {
+    std::vector<const Value*> order;
+    order.reserve(items.size());
+    for (const auto& item : items) {
+        item.as_string_view();      // flattens ropes before the threads read them
+        order.push_back(&item);
+    }
+    parallel_sort(std::span<const Value*>(order), [](const Value* l, const Value* r) {
+        return l->as_string_view() < r->as_string_view();
+    });
+    std::vector<Value> sorted;
+    sorted.reserve(items.size());
+    for (const Value* item : order)
+        sorted.push_back(std::move(*const_cast<Value*>(item)));
+    items = std::move(sorted);
+}
+
+// Values of different types are ordered by type: numbers, strings, booleans, lists, then the rest.
+// Within a type numbers and strings compare by value and lists element by element.
+bool value_less(const Value& l, const Value& r) {
+    if (l.type() != r.type())
+        return l.type() < r.type();
+    switch (l.type()) {
+        case ValueType::number:
+            return l.as_number() < r.as_number() || (std::isnan(r.as_number()) && !std::isnan(l.as_number()));
+        case ValueType::string:
+            return l.as_string_view() < r.as_string_view();
+        case ValueType::boolean:
+            return !l.as_bool() && r.as_bool();
+        case ValueType::list: {
+            const auto& xs = l.as_list();
+            const auto& ys = r.as_list();
+            for (size_t i = 0; i < xs.size() && i < ys.size(); ++i) {
+                Value x = xs.at(i);
+                Value y = ys.at(i);
+                if (value_less(x, y)) return true;
+                if (value_less(y, x)) return false;
             }
+            return xs.size() < ys.size();
+        }
+        default:
+            return false;
+    }
+}
+
+// A function of one argument is a key, a function of two arguments is a comparator
+// that returns true when its first argument goes first. Callbacks run in the
+// interpreter, so these sorts stay on one thread and are stable.
+Value sort_by(const Value& list_value, const Value& func, ExecutionArgs& ex_args) {
+    bool is_key = func.type() == ValueType::stdlib_function;
+    if (func.type() == ValueType::function) {
+        size_t arity = func.as_function().arity_;
+        if (arity != 1 && arity != 2) return Value();
+        is_key = arity == 1;
+    } else if (!is_key) {
+        return Value();
+    }
+
+    // The callbacks may change the list, so it is sorted as a copy; reading it through at()
+    // leaves a packed or lazy list as it is until the result is stored.
+    auto& list = list_value.as_list();
+    std::vector<Value> items;
+    items.reserve(list.size());
+    for (size_t i = 0; i < list.size(); ++i)
+        items.push_back(list.at(i));
+    if (is_key) {
+        std::vector<std::pair<Value, Value>> keyed;
+        keyed.reserve(items.size());
+        for (auto& item : items)
+            keyed.emplace_back(func.call(std::span<const Value>(&item, 1), ex_args), std::move(item));
+        std::stable_sort(keyed.begin(), keyed.end(), [](const auto& l, const auto& r) {
+            return value_less(l.first, r.first);
+        });
+        for (size_t i = 0; i < items.size(); ++i)
+            items[i] = std::move(keyed[i].second);
+    } else {
+        std::stable_sort(items.begin(), items.end(), [&](const Value& l, const Value& r) {
+            Value args[] = {l, r};
+            return func.call(args, ex_args).is_true();
+        });
+    }
+    list.assign(std::move(items));
+    return list_value;
+}
+
+}  // namespace
+
+
+// A stdlib Value points straight at its entry here, so calls skip any name lookup.
+static const StdlibFunction kStdlibFunctions[] = {
+    {"abs", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
+        if (a[0].is_integer())
+            return Value(std::abs(a[0].as_integer()));
+        double x = a[0].as_number();
+        return Value(std::abs(x));
+    }},
+    {"ceil", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
+        double x = a[0].as_number();
+        return Value::make_number(std::ceil(x));
+    }},
+    {"floor", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
+        double x = a[0].as_number();
+        return Value::make_number(std::floor(x));
+    }},
+    {"round", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
+        double x = a[0].as_number();
+        return Value::make_number(std::round(x));
+    }},
+    {"sqrt", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
+        double x = a[0].as_number();
+        return x < 0 ? Value() : Value(std::sqrt(x));
+    }},
+    {"rnd", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        static bool seeded = ([](){ std::srand(static_cast<unsigned>(std::time(nullptr))); return true; })();
+        if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
+        int n = static_cast<int>(a[0].as_number());
+        if (n <= 0) return Value();
+        return Value(static_cast<int64_t>(std::rand() % n));
+    }},
+    {"parse_num", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::string) return Value();
+        const std::string& str = a[0].as_string();
+        char* endp = nullptr;
+        double x = std::strtod(str.c_str(), &endp);
+        if (endp == str.c_str() || *endp != '\0') return Value();
+        return Value::make_number(x);
+    }},
+    {"to_string", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::number) return Value();
+        if (a[0].is_integer())
+            return Value(std::to_string(a[0].as_integer()));
+        double x = a[0].as_number();
+        long long int_x = static_cast<long long>(x);
+        if (std::fabs(x - int_x) < std::numeric_limits<double>::epsilon())
+            return Value(std::to_string(int_x));
+        else
+            return Value(std::to_string(x));
+    }},
+
+    {"len", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1) return Value();
+        if (a[0].type() == ValueType::string) {
+            return Value(static_cast<int64_t>(a[0].as_string_view().size()));
+        }
+        if (a[0].type() == ValueType::list) {
+            return Value(static_cast<int64_t>(a[0].as_list().size()));
+        }
+        if (a[0].type() == ValueType::dict) {
+            return Value(static_cast<int64_t>(a[0].as_dict().size()));
+        }
+        return Value();
+    }},
+    {"lower", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::string) return Value();
+        std::string s = a[0].as_string();
+        for (char &c: s)
+            c = std::tolower(c);
+        return Value(s);
+    }},
+    {"upper", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::string) return Value();
+        std::string s = a[0].as_string();
+        for (char &c: s) c = std::toupper(c);
+        return Value(s);
+    }},
+    {"split", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 2 || a[0].type() != ValueType::string || a[1].type() != ValueType::string)
             return Value();
-        }},
-        {"lower", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::string) return Value();
-            auto s = std::get<std::string>(a[0].get_data());
-            for (char &c: s)
-                c = std::tolower(c);
-            return Value(s);
-        }},
-        {"upper", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::string) return Value();
-            auto s = std::get<std::string>(a[0].get_data());
-            for (char &c: s) c = std::toupper(c);
-            return Value(s);
-        }},
-        {"split", [](auto& a) -> Value {
-            if (a.size() != 2 || a[0].type() != ValueType::string || a[1].type() != ValueType::string)
-                return Value();
-            auto str = std::get<std::string>(a[0].get_data());
-            auto del = std::get<std::string>(a[1].get_data());
-            auto out = std::make_shared<std::vector<Value>>();
-            size_t pos = 0;
-            size_t found = 0;
-            while ((found = str.find(del, pos)) != std::string::npos) {
-                out->emplace_back(str.substr(pos, found - pos));
-                pos = found + del.size();
-            }
-            out->emplace_back(str.substr(pos));
-            return Value(out);
-        }},
-        {"join", [](auto& a) -> Value {
-            if (a.size() != 2 || a[0].type() != ValueType::list || a[1].type() != ValueType::string)
-                return Value();
-            auto list = std::get<List>(a[0].get_data());
-            auto del = std::get<std::string>(a[1].get_data());
-            std::string res;
-            for (size_t i = 0; i < list->size(); ++i) {
-                res += (*list)[i].to_string();
-                if (i + 1 < list->size()) res += del;
-            }
-            return Value(res);
-        }},
-        {"replace", [](auto& a) -> Value {
-            if (a.size() != 3 || a[0].type() != ValueType::string || a[1].type() != ValueType::string || a[2].type() != ValueType::string)
-                return Value();
-            auto str = std::get<std::string>(a[0].get_data());
-            const auto& old_str = std::get<std::string>(a[1].get_data());
-            const auto& new_str = std::get<std::string>(a[2].get_data());
-            size_t pos = 0;
-            while ((pos = str.find(old_str, pos)) != std::string::npos) {
-                str.replace(pos, old_str.size(), new_str);
-                pos += new_str.size();
-            }
-            return Value(str);
-        }},
-        {"push", [](auto& a) -> Value {
-            if (a.size() != 2 || a[0].type() != ValueType::list) return Value();
-            auto list = std::get<List>(a[0].get_data());
-            list->push_back(a[1]);
+        std::string_view str = a[0].as_string_view();
+        std::string_view del = a[1].as_string_view();
+        std::vector<Value> out;
+        size_t pos = 0;
+        size_t found = 0;
+        while ((found = str.find(del, pos)) != std::string_view::npos) {
+            out.emplace_back(std::string(str.substr(pos, found - pos)));
+            pos = found + del.size();
+        }
+        out.emplace_back(std::string(str.substr(pos)));
+        return Value(make_ref<ListObject>(std::move(out)));
+    }},
+    {"join", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 2 || a[0].type() != ValueType::list || a[1].type() != ValueType::string)
             return Value();
-        }},
-        {"pop", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::list) return Value();
-            auto list = std::get<List>(a[0].get_data());
-            if (list->empty()) return Value();
-            Value back = list->back();
-            list->pop_back();
-            return back;
-        }},
-        {"insert", [](auto& a) -> Value {
-            if (a.size() !=3 || a[0].type() != ValueType::list || a[1].type() != ValueType::number)
-                return Value();
-            auto list = std::get<List>(a[0].get_data());
-            int idx = static_cast<int>(std::get<double>(a[1].get_data()));
-            if (idx < 0) idx += list->size();
-            if (idx < 0 || idx > static_cast<int>(list->size())) return Value();
-            list->insert(list->begin() + idx, a[2]);
-            return Value(list);
-        }},
-        {"remove", [](auto& a) -> Value {
-            if (a.size() != 2 || a[0].type() != ValueType::list || a[1].type() != ValueType::number)
-                return Value();
-            auto list = std::get<List>(a[0].get_data());
-            int idx = static_cast<int>(std::get<double>(a[1].get_data()));
-            if (idx < 0) idx += list->size();
-            if (idx < 0||idx >= static_cast<int>(list->size())) return Value();
-            Value val = (*list)[idx];
-            list->erase(list->begin() + idx);
-            return val;
-        }},
-        {"sort", [](auto& a) -> Value {
-            if (a.size() != 1 || a[0].type() != ValueType::list) return Value();
-            auto list = std::get<List>(a[0].get_data());
-            std::sort(list->begin(), list->end(), [](auto &l, auto &r){ return l.to_string() < r.to_string(); });
-            return Value(list);
-        }},
-        {"range", [](auto& a) -> Value {
-            int argc = a.size();
-            if (argc < 1 || argc > 3) 
-                throw std::runtime_error("range: wrong number of argmtans");
-
-            double start, end, step;
-            for (int i = 0; i < argc; ++i) {
-                if (a[i].type() != ValueType::number)
-                    throw std::runtime_error("range arguments must be numbers");
-            }
-            if (argc == 1) {
-                start = 0;
-                end = std::get<double>(a[0].get_data());
-                step = 1;
-            } else if (argc == 2) {
-                start = std::get<double>(a[0].get_data());
-                end = std::get<double>(a[1].get_data());
-                step = 1;
-            } else {
-                start = std::get<double>(a[0].get_data());
-                end = std::get<double>(a[1].get_data());
-                step = std::get<double>(a[2].get_data());
+        const auto& list = a[0].as_list();
+        std::string_view del = a[1].as_string_view();
+        std::string res;
+        for (size_t i = 0; i < list.size(); ++i) {
+            Value item = list.at(i);
+            if (item.type() == ValueType::string)
+                res += item.as_string_view();
+            else
+                res += item.to_string();
+            if (i + 1 < list.size()) res += del;
+        }
+        return Value(res);
+    }},
+    {"replace", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 3 || a[0].type() != ValueType::string || a[1].type() != ValueType::string || a[2].type() != ValueType::string)
+            return Value();
+        std::string str = a[0].as_string();
+        std::string_view old_str = a[1].as_string_view();
+        std::string_view new_str = a[2].as_string_view();
+        size_t pos = 0;
+        while ((pos = str.find(old_str, pos)) != std::string::npos) {
+            str.replace(pos, old_str.size(), new_str);
+            pos += new_str.size();
+        }
+        return Value(str);
+    }},
+    {"push", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 2 || a[0].type() != ValueType::list) return Value();
+        a[0].as_list().push(a[1]);
+        return Value();
+    }},
+    {"pop", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::list) return Value();
+        auto& list = a[0].as_list();
+        if (list.size() == 0) return Value();
+        return list.pop();
+    }},
+    {"insert", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() !=3 || a[0].type() != ValueType::list || a[1].type() != ValueType::number)
+            return Value();
+        auto& list = a[0].as_list();
+        int idx = static_cast<int>(a[1].as_number());
+        if (idx < 0) idx += list.size();
+        if (idx < 0 || idx > static_cast<int>(list.size())) return Value();
+        list.insert(idx, a[2]);
+        return a[0];
+    }},
+    {"remove", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 2 || a[0].type() != ValueType::list || a[1].type() != ValueType::number)
+            return Value();
+        auto& list = a[0].as_list();
+        int idx = static_cast<int>(a[1].as_number());
+        if (idx < 0) idx += list.size();
+        if (idx < 0||idx >= static_cast<int>(list.size())) return Value();
+        return list.remove(idx);
+    }},
+    {"sort", [](StdlibArgs a, ExecutionArgs& ex_args) -> Value {
+        if (a.empty() || a.size() > 2 || a[0].type() != ValueType::list) return Value();
+        if (a.size() == 2) {
+            // Callbacks may grow the VM stack that a points into.
+            Value list = a[0];
+            Value func = a[1];
+            return sort_by(list, func, ex_args);
+        }
+        auto& list = a[0].as_list();
+        if (auto xs = list.numbers()) {
+            sort_numbers(*xs);
+            return a[0];
+        }
+        auto& items = list.items();
+        if (std::all_of(items.begin(), items.end(), [](const Value& v) { return v.type() == ValueType::string; })) {
+            sort_strings(items);
+            return a[0];
+        }
+        std::stable_sort(items.begin(), items.end(), value_less);
+        return a[0];
+    }},
+    {"sum", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::list) return Value();
+        auto xs = a[0].as_list().numbers();
+        if (!xs) return Value();
+        return Value(sum_numbers(*xs));
+    }},
+    {"min", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        return pick_number(a, [](double l, double r) { return r < l ? r : l; });
+    }},
+    {"max", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        return pick_number(a, [](double l, double r) { return r > l ? r : l; });
+    }},
+    {"dot", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 2 || a[0].type() != ValueType::list || a[1].type() != ValueType::list) return Value();
+        auto xs = a[0].as_list().numbers();
+        auto ys = a[1].as_list().numbers();
+        if (!xs || !ys || xs->size() != ys->size()) return Value();
+        return Value(dot_numbers(*xs, *ys));
+    }},
+    {"add", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        return elementwise(a, [](double l, double r) { return l + r; });
+    }},
+    {"mul", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        return elementwise(a, [](double l, double r) { return l * r; });
+    }},
+    {"range", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        int argc = a.size();
+        if (argc < 1 || argc > 3) 
+            throw std::runtime_error("range: wrong number of argmtans");
+
+        double start, end, step;
+        for (int i = 0; i < argc; ++i) {
+            if (a[i].type() != ValueType::number)
+                throw std::runtime_error("range arguments must be numbers");
+        }
+        if (argc == 1) {
+            start = 0;
+            end = a[0].as_number();
+            step = 1;
+        } else if (argc == 2) {
+            start = a[0].as_number();
+            end = a[1].as_number();
+            step = 1;
+        } else {
+            start = a[0].as_number();
+            end = a[1].as_number();
+            step = a[2].as_number();
+        }
+        if (step == 0) 
+            throw std::runtime_error("step in the cycle of the form cannot be equal to 0");
+        if (!std::isfinite(start) || !std::isfinite(end) || !std::isfinite(step))
+            throw std::runtime_error("range bounds and step must be finite");
+        double count = std::ceil((end - start) / step);
+        if (!(count <= kMaxRangeSize))
+            throw std::runtime_error("range too large");
+
+        // Integer progressions stay lazy; fractional ones are built eagerly so that the
+        // accumulated rounding of v += step matches what scripts have always seen.
+        if (std::floor(start) == start && std::floor(end) == end && std::floor(step) == step) {
+            return Value(ListObject::make_range(start, step, count > 0 ? static_cast<size_t>(count) : 0));
+        }
+
+        std::vector<double> out;
+        if (step > 0) {
+            for (double v = start; v < end; v += step) {
+                out.push_back(v);
             }
-            if (step == 0) 
-                throw std::runtime_error("step in the cycle of the form cannot be equal to 0");
-
-            auto out = std::make_shared<std::vector<Value>>();
-            if (step > 0) {
-                for (double v = start; v < end; v += step) {
-                    out->push_back(Value(v));
-                }
-            } else {
-                for (double v = start; v > end; v += step) {
-                    out->push_back(Value(v));
-                }
+        } else {
+            for (double v = start; v > end; v += step) {
+                out.push_back(v);
             }
-            return Value(out);
-        }},
-
-        {"read", [](auto& a) -> Value {
-            std::string str;
-            if (!std::getline(std::cin, str)) 
-                return Value();
-            return Value(str);
-        }},
-    };
-
-    return funcs;
+        }
+        return Value(make_ref<ListObject>(std::move(out)));
+    }},
+
+    {"keys", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::dict) return Value();
+        std::vector<Value> out;
+        a[0].as_dict().for_each([&](const Value& key, const Value&) { out.push_back(key); });
+        return Value(make_ref<ListObject>(std::move(out)));
+    }},
+    {"values", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 1 || a[0].type() != ValueType::dict) return Value();
+        std::vector<Value> out;
+        a[0].as_dict().for_each([&](const Value&, const Value& value) { out.push_back(value); });
+        return Value(make_ref<ListObject>(std::move(out)));
+    }},
+    {"has", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 2 || a[0].type() != ValueType::dict) return Value();
+        return Value(a[0].as_dict().find(a[1]) != nullptr);
+    }},
+    {"get", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() < 2 || a.size() > 3 || a[0].type() != ValueType::dict) return Value();
+        const Value* value = a[0].as_dict().find(a[1]);
+        if (value) return *value;
+        return a.size() == 3 ? a[2] : Value();
+    }},
+    {"set", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 3 || a[0].type() != ValueType::dict || !DictObject::is_valid_key(a[1])) return Value();
+        a[0].as_dict().set(a[1], a[2]);
+        return a[0];
+    }},
+    {"del", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (a.size() != 2 || a[0].type() != ValueType::dict) return Value();
+        return a[0].as_dict().erase(a[1]);
+    }},
+
+    {"gc", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (!a.empty()) return Value();
+        return Value(static_cast<double>(CycleCollector::collect()));
+    }},
+    {"heap_stats", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (!a.empty()) return Value();
+        const HeapStats& stats = CycleCollector::stats();
+        auto dict = make_ref<DictObject>();
+        dict->set(Value(std::string("objects")), Value(static_cast<double>(stats.objects_)));
+        dict->set(Value(std::string("peak_objects")), Value(static_cast<double>(stats.peak_objects_)));
+        dict->set(Value(std::string("allocations")), Value(static_cast<double>(stats.allocations_)));
+        dict->set(Value(std::string("tracked")), Value(static_cast<double>(stats.tracked_)));
+        dict->set(Value(std::string("collections")), Value(static_cast<double>(stats.collections_)));
+        dict->set(Value(std::string("collected")), Value(static_cast<double>(stats.collected_)));
+        return Value(dict);
+    }},
+    {"read", [](StdlibArgs a, ExecutionArgs& ex_args) -> Value {
+        if (!a.empty())
+            throw std::runtime_error("read: wrong number of arguments");
+        std::string str;
+        if (!ex_args.input_.read_line(str))
+            return Value();
+        return Value(std::move(str));
+    }},
+    {"read_all", [](StdlibArgs a, ExecutionArgs& ex_args) -> Value {
+        if (!a.empty())
+            throw std::runtime_error("read_all: wrong number of arguments");
+        return Value(ex_args.input_.read_all());
+    }},
+    {"read_lines", [](StdlibArgs a, ExecutionArgs& ex_args) -> Value {
+        if (!a.empty())
+            throw std::runtime_error("read_lines: wrong number of arguments");
+        std::vector<Value> lines;
+        std::string line;
+        while (ex_args.input_.read_line(line))
+            lines.emplace_back(std::move(line));
+        return Value(make_ref<ListObject>(std::move(lines)));
+    }},
+    {"lines", [](StdlibArgs a, ExecutionArgs&) -> Value {
+        if (!a.empty())
+            throw std::runtime_error("lines: wrong number of arguments");
+        return Value::make_lines();
+    }},
+};
+
+
+std::span<const StdlibFunction> get_stdlib_functions() {
+    return kStdlibFunctions;
+}
+
+
+const StdlibFunction* find_stdlib_function(std::string_view name) {
+    for (const auto& func : kStdlibFunctions) {
+        if (func.name_ == name)
+            return &func;
+    }
+    return nullptr;
 }
\ No newline at end of file
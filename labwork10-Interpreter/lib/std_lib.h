@@ -1,17 +1,25 @@
 #pragma once
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <functional>
+#include <span>
+#include <string_view>
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
 #include <limits>
 #include <iostream>
+#include <thread>
 #include "value.h"
 #include "ast.h"
 
 
-using StdlibFunc = std::function<Value(const std::vector<Value>&)>;
+using StdlibArgs = std::span<const Value>;
 
-std::unordered_map<std::string, StdlibFunc>& get_stdlib_functions();
\ No newline at end of file
+struct StdlibFunction {
+    std::string_view name_;
+    Value (*func_)(StdlibArgs args, ExecutionArgs& ex_args);
+};
+
+std::span<const StdlibFunction> get_stdlib_functions();
+const StdlibFunction* find_stdlib_function(std::string_view name);
\ No newline at end of file
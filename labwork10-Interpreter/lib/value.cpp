@@ -2,14 +2,433 @@
 #include "value.h"
 #include "ast.h"
 #include "std_lib.h"
+#include "vm.h"
+#include <charconv>
 
 
-Value::Value() : type_(ValueType::nil), data_(false) {}
-Value::Value(double x) : type_(ValueType::number), data_(x) {}
-Value::Value(const std::string& s) : type_(ValueType::string), data_(s) {}
-Value::Value(bool b) : type_(ValueType::boolean), data_(b) {}
-Value::Value(const List& list) : type_(ValueType::list), data_(list) {}
-Value::Value(std::shared_ptr<FunctionObject> fn) : type_(ValueType::function), data_(fn) {}
+Value::Value(std::string s) : type_(ValueType::string), object_(new StringObject(std::move(s))) {
+    retain(object_);
+}
+
+Value::Value(const Ref<StringObject>& str) : type_(ValueType::string), object_(str.get()) {
+    retain(object_);
+}
+
+Value::Value(const List& list) : type_(ValueType::list), object_(list.get()) {
+    retain(object_);
+}
+
+Value::Value(const Ref<DictObject>& dict) : type_(ValueType::dict), object_(dict.get()) {
+    retain(object_);
+}
+
+Value::Value(const Ref<FunctionObject>& fn) : type_(ValueType::function), object_(fn.get()) {
+    retain(object_);
+}
+
+
+StringObject::StringObject(Ref<StringObject> left, Ref<StringObject> right)
+    : left_(std::move(left)), right_(std::move(right)) {
+    size_ = left_->size_ + right_->size_;
+}
+
+
+// Ropes built in a loop are as deep as the loop is long, so they are taken apart
+// iteratively instead of through nested destructors.
+StringObject::~StringObject() {
+    std::vector<Ref<StringObject>> pending;
+    if (left_) {
+        pending.push_back(std::move(left_));
+        pending.push_back(std::move(right_));
+    }
+    while (!pending.empty()) {
+        Ref<StringObject> node = std::move(pending.back());
+        pending.pop_back();
+        if (node->ref_count_ == 1 && node->left_) {
+            pending.push_back(std::move(node->left_));
+            pending.push_back(std::move(node->right_));
+        }
+    }
+}
+
+
+Ref<StringObject> StringObject::concat(StringObject& left, StringObject& right) {
+    if (left.size_ + right.size_ < kMinRopeSize)
+        return make_ref<StringObject>(left.str() + right.str());
+    return make_ref<StringObject>(Ref<StringObject>(&left), Ref<StringObject>(&right));
+}
+
+
+void StringObject::append(const std::string& tail) {
+    if (left_)
+        flatten();
+    str_ += tail;
+    size_ = str_.size();
+}
+
+
+void StringObject::flatten() const {
+    // Right-hand pieces along the left spine, the outermost first.
+    std::vector<const StringObject*> pieces;
+    const StringObject* leftmost = this;
+    bool exclusive = true;
+    while (leftmost->left_) {
+        pieces.push_back(leftmost->right_.get());
+        leftmost = leftmost->left_.get();
+        exclusive = exclusive && leftmost->ref_count_ == 1;
+    }
+
+    std::string result = exclusive ? std::move(leftmost->str_) : leftmost->str_;
+    result.reserve(size_);
+    std::vector<const StringObject*> stack;
+    for (auto it = pieces.rbegin(); it != pieces.rend(); ++it) {
+        stack.push_back(*it);
+        while (!stack.empty()) {
+            const StringObject* node = stack.back();
+            stack.pop_back();
+            if (node->left_) {
+                stack.push_back(node->right_.get());
+                stack.push_back(node->left_.get());
+            } else {
+                result += node->str_;
+            }
+        }
+    }
+
+    str_ = std::move(result);
+    left_ = Ref<StringObject>();
+    right_ = Ref<StringObject>();
+}
+
+
+FunctionObject::FunctionObject(size_t arity, const FrameLayout& frame, ASTNode* body, Ref<Environment> env)
+    : arity_(arity), frame_(frame), body_(body), env_(std::move(env)) {}
+
+FunctionObject::~FunctionObject() = default;
+
+void FunctionObject::trace(GcVisitor& visitor) const {
+    visitor.visit(env_.get());
+}
+
+void FunctionObject::clear() {
+    env_ = Ref<Environment>();
+}
+
+
+ListObject::ListObject(std::vector<Value> items) {
+    assign(std::move(items));
+}
+
+
+ListObject::ListObject(std::vector<double> numbers) : numbers_(std::move(numbers)) {}
+
+
+void ListObject::assign(std::vector<Value> items) {
+    bool all_numbers = true;
+    for (const auto& item : items) {
+        if (item.type() != ValueType::number) {
+            all_numbers = false;
+            break;
+        }
+    }
+    if (!all_numbers) {
+        storage_ = Storage::values;
+        numbers_ = {};
+        items_ = std::move(items);
+        return;
+    }
+    storage_ = Storage::numbers;
+    items_ = {};
+    numbers_.clear();
+    numbers_.reserve(items.size());
+    for (const auto& item : items)
+        numbers_.push_back(item.as_number());
+}
+
+
+Ref<ListObject> ListObject::make_range(double start, double step, size_t size) {
+    auto list = make_ref<ListObject>();
+    list->storage_ = Storage::range;
+    list->range_start_ = start;
+    list->range_step_ = step;
+    list->range_size_ = size;
+    return list;
+}
+
+
+Ref<ListObject> ListObject::slice(size_t start, size_t end) const {
+    switch (storage_) {
+        case Storage::numbers:
+            return make_ref<ListObject>(std::vector<double>(numbers_.begin() + start, numbers_.begin() + end));
+        case Storage::values:
+            return make_ref<ListObject>(std::vector<Value>(items_.begin() + start, items_.begin() + end));
+        case Storage::range:
+            break;
+    }
+    return make_range(range_start_ + range_step_ * start, range_step_, end - start);
+}
+
+
+Ref<ListObject> ListObject::concat(const ListObject& other) const {
+    if (storage_ != Storage::values && other.storage_ != Storage::values) {
+        std::vector<double> numbers;
+        numbers.reserve(size() + other.size());
+        for (const ListObject* list : {this, &other}) {
+            if (list->storage_ == Storage::numbers) {
+                numbers.insert(numbers.end(), list->numbers_.begin(), list->numbers_.end());
+            } else {
+                for (size_t i = 0; i < list->range_size_; ++i)
+                    numbers.push_back(list->range_start_ + list->range_step_ * i);
+            }
+        }
+        return make_ref<ListObject>(std::move(numbers));
+    }
+    std::vector<Value> items;
+    items.reserve(size() + other.size());
+    for (size_t i = 0; i < size(); ++i)
+        items.push_back(at(i));
+    for (size_t i = 0; i < other.size(); ++i)
+        items.push_back(other.at(i));
+    return make_ref<ListObject>(std::move(items));
+}
+
+
+// Ranges become packed numbers on the first mutation; packed numbers become
+// generic values on the first stored non-number.
+void ListObject::push(const Value& value) {
+    if (storage_ == Storage::range)
+        numbers();
+    if (storage_ == Storage::numbers && value.type() == ValueType::number)
+        numbers_.push_back(value.as_number());
+    else
+        items().push_back(value);
+}
+
+
+Value ListObject::pop() {
+    if (storage_ == Storage::range)
+        numbers();
+    if (storage_ == Storage::numbers) {
+        double back = numbers_.back();
+        numbers_.pop_back();
+        return Value::make_number(back);
+    }
+    Value back = std::move(items_.back());
+    items_.pop_back();
+    return back;
+}
+
+
+void ListObject::insert(size_t i, const Value& value) {
+    if (storage_ == Storage::range)
+        numbers();
+    if (storage_ == Storage::numbers && value.type() == ValueType::number) {
+        numbers_.insert(numbers_.begin() + i, value.as_number());
+        return;
+    }
+    auto& items = this->items();
+    items.insert(items.begin() + i, value);
+}
+
+
+Value ListObject::remove(size_t i) {
+    if (storage_ == Storage::range)
+        numbers();
+    if (storage_ == Storage::numbers) {
+        double value = numbers_[i];
+        numbers_.erase(numbers_.begin() + i);
+        return Value::make_number(value);
+    }
+    Value value = std::move(items_[i]);
+    items_.erase(items_.begin() + i);
+    return value;
+}
+
+
+std::optional<std::span<double>> ListObject::numbers() {
+    if (storage_ == Storage::range) {
+        numbers_.reserve(range_size_);
+        for (size_t i = 0; i < range_size_; ++i)
+            numbers_.push_back(range_start_ + range_step_ * i);
+    } else if (storage_ == Storage::values) {
+        for (const auto& item : items_) {
+            if (item.type() != ValueType::number)
+                return std::nullopt;
+        }
+        numbers_.reserve(items_.size());
+        for (const auto& item : items_)
+            numbers_.push_back(item.as_number());
+        items_ = {};
+    }
+    storage_ = Storage::numbers;
+    return std::span<double>(numbers_);
+}
+
+
+std::vector<Value>& ListObject::items() {
+    if (storage_ != Storage::values)
+        unpack();
+    return items_;
+}
+
+
+void ListObject::unpack() {
+    items_.reserve(size());
+    for (size_t i = 0; i < size(); ++i)
+        items_.push_back(at(i));
+    numbers_ = {};
+    storage_ = Storage::values;
+}
+
+
+bool ListObject::operator==(const ListObject& other) const {
+    if (size() != other.size())
+        return false;
+    if (is_range() && other.is_range())
+        return size() == 0 || (range_start_ == other.range_start_ && range_step_ == other.range_step_);
+    if (storage_ == Storage::numbers && other.storage_ == Storage::numbers)
+        return numbers_ == other.numbers_;
+    for (size_t i = 0; i < size(); ++i) {
+        if (at(i) != other.at(i))
+            return false;
+    }
+    return true;
+}
+
+
+void ListObject::trace(GcVisitor& visitor) const {
+    for (const auto& item : items_)
+        visitor.visit(item.heap_object());
+}
+
+void ListObject::clear() {
+    auto items = std::move(items_);
+    items_.clear();
+}
+
+
+bool DictObject::is_valid_key(const Value& key) {
+    switch (key.type()) {
+        case ValueType::number:
+            return !std::isnan(key.as_number());
+        case ValueType::string:
+        case ValueType::boolean:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+size_t DictObject::hash(const Value& key) {
+    switch (key.type()) {
+        case ValueType::number: {
+            double x = key.as_number();
+            return std::hash<double>()(x == 0 ? 0.0 : x);
+        }
+        case ValueType::string:
+            return std::hash<std::string_view>()(key.as_string_view());
+        default:
+            return key.as_bool() ? 1 : 2;
+    }
+}
+
+
+size_t DictObject::probe(const Value& key, size_t hash) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        if (slots_[slot] == kEmpty)
+            return slot;
+        const Entry& entry = entries_[slots_[slot]];
+        if (entry.hash_ == hash && entry.key_ == key)
+            return slot;
+    }
+}
+
+
+const Value* DictObject::find(const Value& key) const {
+    if (slots_.empty() || !is_valid_key(key))
+        return nullptr;
+    uint32_t entry = slots_[probe(key, hash(key))];
+    return entry == kEmpty ? nullptr : &entries_[entry].value_;
+}
+
+
+void DictObject::set(const Value& key, const Value& value) {
+    if (!is_valid_key(key))
+        throw std::runtime_error("invalid dictionary key");
+    // Tombstones count towards the load, so that probing always reaches an empty slot.
+    if ((entries_.size() + 1) * 4 > slots_.size() * 3) {
+        size_t slot_count = 8;
+        while (slot_count < (size_ + 1) * 2)
+            slot_count *= 2;
+        rehash(slot_count);
+    }
+    size_t h = hash(key);
+    size_t slot = probe(key, h);
+    if (slots_[slot] != kEmpty) {
+        entries_[slots_[slot]].value_ = value;
+        return;
+    }
+    slots_[slot] = static_cast<uint32_t>(entries_.size());
+    entries_.push_back({key, value, h});
+    ++size_;
+}
+
+
+Value DictObject::erase(const Value& key) {
+    if (slots_.empty() || !is_valid_key(key))
+        return Value();
+    uint32_t entry = slots_[probe(key, hash(key))];
+    if (entry == kEmpty)
+        return Value();
+    Value value = std::move(entries_[entry].value_);
+    entries_[entry].key_ = Value();
+    if (--size_ == 0) {
+        entries_.clear();
+        slots_.clear();
+    }
+    return value;
+}
+
+
+void DictObject::trace(GcVisitor& visitor) const {
+    for (const auto& entry : entries_)
+        visitor.visit(entry.value_.heap_object());
+}
+
+void DictObject::clear() {
+    auto entries = std::move(entries_);
+    entries_.clear();
+    slots_.clear();
+    size_ = 0;
+}
+
+
+void DictObject::rehash(size_t slot_count) {
+    std::erase_if(entries_, [](const Entry& entry) { return entry.key_.is_nil(); });
+    slots_.assign(slot_count, kEmpty);
+    size_t mask = slot_count - 1;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        size_t slot = entries_[i].hash_ & mask;
+        while (slots_[slot] != kEmpty)
+            slot = (slot + 1) & mask;
+        slots_[slot] = static_cast<uint32_t>(i);
+    }
+}
+
+
+bool DictObject::operator==(const DictObject& other) const {
+    if (size_ != other.size_)
+        return false;
+    bool equal = true;
+    for_each([&](const Value& key, const Value& value) {
+        const Value* found = other.find(key);
+        if (!found || *found != value)
+            equal = false;
+    });
+    return equal;
+}
 
 
 bool Value::is_nil() const {
@@ -17,45 +436,88 @@ bool Value::is_nil() const {
 }
 
 
-Value Value::make_stdlib_func(const std::string& name) {
-    Value func;
-    func.type_ = ValueType::stdlib_function;
-    func.data_ = name;
-    return func;
+Value Value::make_stdlib_func(const StdlibFunction* func) {
+    Value value;
+    value.type_ = ValueType::stdlib_function;
+    value.stdlib_ = func;
+    return value;
 }
 
 
 std::string Value::to_string() const {
+    if (type_ == ValueType::string)
+        return as_string();
+    std::string res;
+    append_to(res);
+    return res;
+}
+
+
+namespace {
+
+// Integers as %lld, other numbers as %f: what std::to_string prints, without the locale.
+void append_number(std::string& out, bool integer, int64_t int_value, double value) {
+    char buf[400];      // %f of the largest double has 309 digits before the point
+    std::to_chars_result result;
+    if (integer)
+        result = std::to_chars(buf, buf + sizeof(buf), int_value);
+    else if (std::floor(value) == value)
+        result = std::to_chars(buf, buf + sizeof(buf), static_cast<long long>(value));
+    else
+        result = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed, 6);
+    out.append(buf, result.ptr);
+}
+
+}  // namespace
+
+
+void Value::append_to(std::string& out) const {
     switch (type_) {
-        case ValueType::number: {
-            double d = std::get<double>(data_);
-            if (std::floor(d) == d) {
-                return std::to_string(static_cast<long long>(d));
-            } else {
-                return std::to_string(d);
-            }
-        }
+        case ValueType::number:
+            append_number(out, integer_, int_, number_);
+            return;
         case ValueType::string:
-            return std::get<std::string>(data_);
+            out += as_string();
+            return;
         case ValueType::boolean:
-            return std::get<bool>(data_) ? "true" : "false";
+            out += boolean_ ? "true" : "false";
+            return;
         case ValueType::list: {
-            std::string res = "[";
-            const auto& list = *std::get<List>(data_);
+            out += '[';
+            const auto& list = as_list();
             for (size_t i = 0; i < list.size(); ++i) {
-                res += list[i].to_string();
-                if (i + 1 != list.size()) res += ", ";
+                list.at(i).append_to(out);
+                if (i + 1 != list.size()) out += ", ";
             }
-            return res + "]";
+            out += ']';
+            return;
+        }
+        case ValueType::dict: {
+            out += '{';
+            bool first = true;
+            as_dict().for_each([&](const Value& key, const Value& value) {
+                if (!first) out += ", ";
+                first = false;
+                key.append_to(out);
+                out += ": ";
+                value.append_to(out);
+            });
+            out += '}';
+            return;
         }
         case ValueType::function:
-            return "<function>";
+            out += "<function>";
+            return;
         case ValueType::nil:
-            return "nil";
+            out += "nil";
+            return;
         case ValueType::stdlib_function:
-            return "<stdlib>";
+            out += "<stdlib>";
+            return;
+        case ValueType::lines:
+            out += "<lines>";
+            return;
     }
-    return "nil";
 }
 
 
@@ -64,68 +526,103 @@ bool Value::to_bool() const {
         case ValueType::nil:
             return false;
         case ValueType::boolean:
-            return std::get<bool>(data_);
+            return boolean_;
         case ValueType::number:
-            return std::get<double>(data_) != 0.0;
+            return integer_ ? int_ != 0 : number_ != 0.0;
         case ValueType::string:
-            return !std::get<std::string>(data_).empty();
+            return !as_string().empty();
         case ValueType::list:
-            return !std::get<List>(data_)->empty();
+            return as_list().size() != 0;
+        case ValueType::dict:
+            return as_dict().size() != 0;
         case ValueType::function:
         case ValueType::stdlib_function:
+        case ValueType::lines:
             return true;
     }
     return false;
 }
 
 
+// Condition of if/while: only booleans and non-zero numbers hold.
+bool Value::is_true() const {
+    if (type_ == ValueType::boolean)
+        return boolean_;
+    if (type_ == ValueType::number)
+        return integer_ ? int_ != 0 : number_ != 0.0;
+    return false;
+}
+
+
 Value Value::operator+(const Value& other) const {
     if (type_ == ValueType::number && other.type_ == ValueType::number)
-        return Value(std::get<double>(data_) + std::get<double>(other.data_));
+        return add_numbers(*this, other);
     if (type_ == ValueType::string && other.type_ == ValueType::string)
-        return Value(std::get<std::string>(data_) + std::get<std::string>(other.data_));
-    if (type_ == ValueType::list && other.type_ == ValueType::list) {
-        auto result = std::make_shared<std::vector<Value>>(*std::get<List>(data_));
-        const auto& other_list = *std::get<List>(other.data_);
-        result->insert(result->end(), other_list.begin(), other_list.end());
-        return Value(result);
-    }
+        return Value(StringObject::concat(*static_cast<StringObject*>(object_), *static_cast<StringObject*>(other.object_)));
+    if (type_ == ValueType::list && other.type_ == ValueType::list)
+        return Value(as_list().concat(other.as_list()));
     throw std::runtime_error("invalid types (operator '+')");
 }
 
 
+// In place for numbers and for strings held only here, which keeps `x += c` free of temporaries.
+Value& Value::operator+=(const Value& other) {
+    if (type_ == ValueType::number && other.type_ == ValueType::number)
+        *this = add_numbers(*this, other);
+    else if (type_ == ValueType::string && other.type_ == ValueType::string && object_->ref_count_ == 1)
+        static_cast<StringObject*>(object_)->append(other.as_string());
+    else
+        *this = *this + other;
+    return *this;
+}
+
+
+Value& Value::operator-=(const Value& other) {
+    if (type_ == ValueType::number && other.type_ == ValueType::number)
+        *this = sub_numbers(*this, other);
+    else
+        *this = *this - other;
+    return *this;
+}
+
+
 Value Value::operator-(const Value& other) const {
     if (type_ == ValueType::number && other.type_ == ValueType::number)
-        return Value(std::get<double>(data_) - std::get<double>(other.data_));
+        return sub_numbers(*this, other);
     if (type_ == ValueType::string && other.type_ == ValueType::string) {
-        std::string str = std::get<std::string>(data_);
-        std::string suffix = std::get<std::string>(other.data_);
-        if (str.size() >= suffix.size() &&
-            str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0) {
-            return Value(str.substr(0, str.size() - suffix.size()));
-        }
-        return Value(str);
+        std::string_view str = as_string_view();
+        std::string_view suffix = other.as_string_view();
+        if (str.ends_with(suffix))
+            return Value(std::string(str.substr(0, str.size() - suffix.size())));
+        return *this;
     }
     throw std::runtime_error("invalid types (operator '-')");
 }
 
 
 Value Value::operator*(const Value& other) const {
+    if (type_ == ValueType::number && other.type_ == ValueType::number)
+        return mul_numbers(*this, other);
     if (other.type_ == ValueType::number || other.type_ == ValueType::boolean) {
         double factor;
         if (other.type_ == ValueType::number) {
-            factor = std::get<double>(other.data_);
+            factor = other.as_number();
         } else if (other.type_ == ValueType::boolean) {
-            factor = std::get<bool>(other.data_);
+            factor = other.boolean_;
         }
         if (type_ == ValueType::number)
-            return Value(std::get<double>(data_) * factor);
+            return Value(as_number() * factor);
         else if (type_ == ValueType::string) {
-            std::string str = "";
-            for (size_t i = 0; i < factor; ++i) {
-                str += std::get<std::string>(data_);
+            if (std::isinf(factor))
+                throw std::runtime_error("invalid types (operator '*')");
+            const std::string& piece = as_string();
+            size_t count = factor > 0 ? static_cast<size_t>(std::ceil(factor)) : 0;
+            std::string str;
+            str.reserve(piece.size() * count);
+            for (size_t i = 0; i < count; ++i) {
+                str += piece;
             }
-            return Value(str);
+            return Value(std::move(str));
         }
     }
     throw std::runtime_error("invalid types (operator '*')");
@@ -133,25 +630,31 @@ Value Value::operator*(const Value& other) const {
 
 
 Value Value::operator/(const Value& other) const {
-    if (type_ == ValueType::number && other.type_ == ValueType::number) {
-        if (std::fabs(std::get<double>(other.data_) - 0.0) < std::numeric_limits<double>::epsilon()) 
-            return Value();
-        return Value(std::get<double>(data_) / std::get<double>(other.data_));
-    }
+    if (type_ == ValueType::number && other.type_ == ValueType::number)
+        return div_numbers(*this, other);
     throw std::runtime_error("invalid types (operator '/')");
 }
 
 
+Value Value::divide(double lhs, double rhs) {
+    if (std::fabs(rhs - 0.0) < std::numeric_limits<double>::epsilon())
+        return Value();
+    return Value(lhs / rhs);
+}
+
+
 Value Value::operator%(const Value& other) const {
     if (type_ == ValueType::number && other.type_ == ValueType::number)
-        return Value(std::fmod(std::get<double>(data_), std::get<double>(other.data_)));
+        return mod_numbers(*this, other);
     throw std::runtime_error("invalid types (operator '%')");
 }
 
 
 Value Value::pow(const Value& other) const {
-    if (type_ == ValueType::number && other.type_ == ValueType::number)
-        return Value(std::pow(std::get<double>(data_), std::get<double>(other.data_)));
+    if (type_ == ValueType::number && other.type_ == ValueType::number) {
+        double result = std::pow(as_number(), other.as_number());
+        return integer_ && other.integer_ ? make_number(result) : Value(result);
+    }
     throw std::runtime_error("invalid types (operator '^')");
 }
 
@@ -160,18 +663,21 @@ bool Value::operator==(const Value& other) const {
     if (type_ != other.type_) return false;
     switch (type_) {
         case ValueType::number:
-            return std::get<double>(data_) == std::get<double>(other.data_);
+            return as_number() == other.as_number();
         case ValueType::string:
-            return std::get<std::string>(data_) == std::get<std::string>(other.data_);
+            return as_string() == other.as_string();
         case ValueType::boolean:
-            return std::get<bool>(data_) == std::get<bool>(other.data_);
+            return boolean_ == other.boolean_;
         case ValueType::list:
-            return *std::get<List>(data_) == *std::get<List>(other.data_);
+            return as_list() == other.as_list();
+        case ValueType::dict:
+            return as_dict() == other.as_dict();
         case ValueType::function:
-            return std::get<std::shared_ptr<FunctionObject>>(data_) == std::get<std::shared_ptr<FunctionObject>>(other.data_);
+            return object_ == other.object_;
         case ValueType::stdlib_function:
-            return std::get<std::string>(data_) == std::get<std::string>(other.data_);
+            return stdlib_ == other.stdlib_;
         case ValueType::nil:
+        case ValueType::lines:
             return true;
     }
     return false;
@@ -195,76 +701,85 @@ Value Value::not_equal(const Value& other) const {
 
 Value Value::operator<(const Value& other) const {
     if (type_ == ValueType::number && other.type_ == ValueType::number)
-        return Value(std::get<double>(data_) < std::get<double>(other.data_));
+        return Value(as_number() < other.as_number());
     if (type_ == ValueType::string && other.type_ == ValueType::string)
-        return Value(std::get<std::string>(data_) < std::get<std::string>(other.data_));
+        return Value(as_string() < other.as_string());
     throw std::runtime_error("invalid types (operator '<')");
 }
 
 
 Value Value::operator<=(const Value& other) const {
     if (type_ == ValueType::number && other.type_ == ValueType::number)
-        return Value(std::get<double>(data_) <= std::get<double>(other.data_));
+        return Value(as_number() <= other.as_number());
     if (type_ == ValueType::string && other.type_ == ValueType::string)
-        return Value(std::get<std::string>(data_) <= std::get<std::string>(other.data_));
+        return Value(as_string() <= other.as_string());
     throw std::runtime_error("invalid types (operator '<=')");
 }
 
 
 Value Value::operator>(const Value& other) const {
     if (type_ == ValueType::number && other.type_ == ValueType::number)
-        return Value(std::get<double>(data_) > std::get<double>(other.data_));
+        return Value(as_number() > other.as_number());
     if (type_ == ValueType::string && other.type_ == ValueType::string)
-        return Value(std::get<std::string>(data_) > std::get<std::string>(other.data_));
+        return Value(as_string() > other.as_string());
     throw std::runtime_error("invalid types (operator '>')");
 }
 
 
 Value Value::operator>=(const Value& other) const {
     if (type_ == ValueType::number && other.type_ == ValueType::number)
-        return Value(std::get<double>(data_) >= std::get<double>(other.data_));
+        return Value(as_number() >= other.as_number());
     if (type_ == ValueType::string && other.type_ == ValueType::string)
-        return Value(std::get<std::string>(data_) >= std::get<std::string>(other.data_));
+        return Value(as_string() >= other.as_string());
     throw std::runtime_error("invalid types (operator '>=')");
 }
 
 
-Value Value::logic_and(const Value& other) const {
-    return Value(to_bool() && other.to_bool());
-}
-
-Value Value::logic_or(const Value& other) const {
-    return Value(to_bool() || other.to_bool());
+Value Value::logic_not() const {
+    return Value(!to_bool());
 }
 
 
-Value Value::logic_not() const {
-    return Value(!to_bool());
+int Value::to_index() const {
+    if (type_ != ValueType::number)
+        throw std::runtime_error("index must be a number");
+    if (!integer_)
+        return static_cast<int>(number_);
+    // Out of range, like the conversion of a too large double on x86.
+    constexpr int kMin = std::numeric_limits<int>::min();
+    return int_ >= kMin && int_ <= std::numeric_limits<int>::max() ? static_cast<int>(int_) : kMin;
 }
 
 
-Value Value::index(int idx) const {
+Value Value::index(const Value& key) const {
+    if (type_ == ValueType::dict) {
+        const Value* value = as_dict().find(key);
+        if (!value)
+            throw std::runtime_error("key not found: " + key.to_string());
+        return *value;
+    }
+    int idx = key.to_index();
     if (type_ == ValueType::string) {
-        const auto& s = std::get<std::string>(data_);
+        const auto& s = as_string();
         if (idx < 0) idx += static_cast<int>(s.size());
         if (idx < 0 || idx >= static_cast<int>(s.size()))
             throw std::runtime_error("index out of range");
         return Value(std::string(1, s[idx]));
     }
     if (type_ == ValueType::list) {
-        const auto& l = *std::get<List>(data_);
+        const auto& l = as_list();
         if (idx < 0) idx += static_cast<int>(l.size());
         if (idx < 0 || idx >= static_cast<int>(l.size()))
             throw std::runtime_error("index out of range");
-        return l[idx];
+        return l.at(idx);
     }
-    throw std::runtime_error("index can only be applied to str and lists");
+    throw std::runtime_error("index can only be applied to str, lists and dictionaries");
 }
 
 
 Value Value::slice(int start, int end) const {
     if (type_ == ValueType::string) {
-        const auto& s = std::get<std::string>(data_);
+        const auto& s = as_string();
         int len = static_cast<int>(s.size());
         if (start < 0) start += len;
         if (end < 0) end += len;
@@ -274,37 +789,45 @@ Value Value::slice(int start, int end) const {
         return Value(s.substr(start, end - start));
     }
     if (type_ == ValueType::list) {
-        const auto& l = *std::get<List>(data_);
+        const auto& l = as_list();
         int len = static_cast<int>(l.size());
         if (start < 0) start += len;
         if (end < 0) end += len;
         start = std::max(0, std::min(start, len));
         end   = std::max(0, std::min(end, len));
         if (start > end) start = end;
-        auto sub = std::make_shared<std::vector<Value>>(l.begin() + start, l.begin() + end);
-        return Value(sub);
+        return Value(l.slice(start, end));
     }
     throw std::runtime_error("slice can only be applied to str and lists");
 }
 
 
-Value Value::call(const std::vector<Value>& args, ExecutionArgs& ex_args) const {
-    if (type_ == ValueType::stdlib_function) {
-        const auto& name = std::get<std::string>(data_);
-        auto& std_functions = get_stdlib_functions();
-        auto it = std_functions.find(name);
-        if (it == std_functions.end())
-            throw std::runtime_error("undefined name: " + name);
-        return it->second(args);
-    }
+Value Value::call(std::span<const Value> args, ExecutionArgs& ex_args) const {
+    if (type_ == ValueType::stdlib_function)
+        return stdlib_->func_(args, ex_args);
     if (type_ != ValueType::function)
         throw std::runtime_error("call non-function");
-    const auto& func = std::get<std::shared_ptr<FunctionObject>>(data_);
-    if (args.size() != func->params_.size())
+    const FunctionObject* func = &as_function();
+    if (!func->body_) {
+        if (ex_args.vm_)
+            return ex_args.vm_->call_function(*this, args);
+        throw std::runtime_error("call of a function without syntax tree");
+    }
+    if (args.size() != func->arity_)
         throw std::runtime_error("incorrect number of arguments");
-    ExecutionArgs local(func->env_, ex_args.output_, ex_args.input_);
+    if (reinterpret_cast<uintptr_t>(&func) < ex_args.stack_limit_)
+        throw std::runtime_error("stack overflow");
+    FrameGuard frame(ex_args.arena_, func->env_, func->frame_);
     for (size_t i = 0; i < args.size(); ++i)
-        local.env_->declare(func->params_[i], args[i]);
+        frame.get()->declare(i, args[i]);
+    ExecutionArgs local(frame.get(), ex_args.arena_, ex_args.output_, ex_args.input_);
+    local.vm_ = ex_args.vm_;
+    local.profiler_ = ex_args.profiler_;
+    local.stack_limit_ = ex_args.stack_limit_;
+    if (local.profiler_)
+        local.profiler_->enter(func->info_);
     Value result = func->body_->execute(local);
+    if (local.profiler_)
+        local.profiler_->leave();
     return local.is_returning_ ? local.return_value_ : result;
 }
\ No newline at end of file
@@ -1,58 +1,147 @@
 #pragma once
 #include <stdexcept>
 #include <cmath>
-#include <variant>
+#include <string_view>
+#include <span>
+#include <optional>
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include "heap.h"
+#include "environment.h"
 
 
-using List = std::shared_ptr<std::vector<class Value>>;
-
-class Environment;
 class ASTNode;
 struct ExecutionArgs;
-using ASTPtr = std::unique_ptr<ASTNode>;
-
-struct FunctionObject {
-    std::vector<std::string> params_;
-    ASTPtr body_;
-    std::shared_ptr<Environment> env_;
+struct FunctionPrototype;
+struct FunctionInfo;
+struct StringObject;
+struct ListObject;
+class DictObject;
+struct FunctionObject;
+struct StdlibFunction;
 
-    FunctionObject(std::vector<std::string> params, ASTPtr body, std::shared_ptr<Environment> env)
-        : params_(std::move(params)), body_(std::move(body)), env_(std::move(env)) {}
-};
+using List = Ref<ListObject>;
 
-enum class ValueType {
+enum class ValueType : uint8_t {
     number,
     string,
     boolean,
     list,
+    dict,
     function,
     stdlib_function,
-    nil
+    nil,
+    lines       // the script input, iterated line by line by for loops; returned by lines()
 };
 
+// A type tag next to one 8-byte payload: numbers and booleans are stored inline,
+// strings, lists, dictionaries and functions live behind a single refcounted HeapObject pointer,
+// stdlib functions point into the static table of std_lib.
+//
+// A number is a double, or an int64 when it is an integer within kMaxInteger. Doubles hold
+// such integers exactly, so the integer form gives the same results as double arithmetic and
+// only makes counters, indices and `%` cheaper; results that leave the range become doubles.
 class Value {
 public:
-    Value();
-    explicit Value(double x);
-    explicit Value(const std::string& s);
-    explicit Value(bool b);
+    static constexpr int64_t kMaxInteger = int64_t(1) << 53;
+
+    Value() : type_(ValueType::nil), number_(0) {}
+    explicit Value(double x) : type_(ValueType::number), number_(x) {}
+    // A double when x is out of the integer range.
+    explicit Value(int64_t x) : type_(ValueType::number) {
+        if (x >= -kMaxInteger && x <= kMaxInteger) {
+            integer_ = true;
+            int_ = x;
+        } else {
+            number_ = static_cast<double>(x);
+        }
+    }
+    // The integer form of x if x is an integer, otherwise x as a double.
+    static Value make_number(double x) {
+        if (x >= -kMaxInteger && x <= kMaxInteger && static_cast<double>(static_cast<int64_t>(x)) == x)
+            return Value(static_cast<int64_t>(x));
+        return Value(x);
+    }
+    explicit Value(std::string s);
+    explicit Value(const Ref<StringObject>& str);
+    explicit Value(bool b) : type_(ValueType::boolean), boolean_(b) {}
     explicit Value(const List& list);
-    explicit Value(std::shared_ptr<FunctionObject> fn);
-    static Value make_stdlib_func(const std::string& name);
+    explicit Value(const Ref<DictObject>& dict);
+    explicit Value(const Ref<FunctionObject>& fn);
+    static Value make_stdlib_func(const StdlibFunction* func);
+    static Value make_lines() {
+        Value value;
+        value.type_ = ValueType::lines;
+        return value;
+    }
+
+    Value(const Value& other) : type_(other.type_), integer_(other.integer_), number_(other.number_) {
+        if (is_heap()) retain(object_);
+    }
+    Value(Value&& other) noexcept : type_(other.type_), integer_(other.integer_), number_(other.number_) {
+        other.type_ = ValueType::nil;
+    }
+    Value& operator=(const Value& other) {
+        if (other.is_heap()) retain(other.object_);
+        if (is_heap()) release(object_);
+        type_ = other.type_;
+        integer_ = other.integer_;
+        number_ = other.number_;
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            if (is_heap()) release(object_);
+            type_ = other.type_;
+            integer_ = other.integer_;
+            number_ = other.number_;
+            other.type_ = ValueType::nil;
+        }
+        return *this;
+    }
+    ~Value() {
+        if (is_heap()) release(object_);
+    }
 
     ValueType type() const { return type_; }
-    auto get_data() const { return data_; }
+    // The referenced heap object, or nullptr for inline values.
+    HeapObject* heap_object() const { return is_heap() ? object_ : nullptr; }
+
+    // Typed access without copying; the caller checks type() first.
+    double as_number() const { return integer_ ? static_cast<double>(int_) : number_; }
+    // A number in the integer form; as_integer() is valid only then.
+    bool is_integer() const { return integer_; }
+    int64_t as_integer() const { return int_; }
+    bool as_bool() const { return boolean_; }
+    const std::string& as_string() const;
+    std::string_view as_string_view() const { return as_string(); }
+    ListObject& as_list() const;
+    DictObject& as_dict() const;
+    FunctionObject& as_function() const;
+
     bool is_nil() const;
     std::string to_string() const;
+    // Appends to_string() to out.
+    void append_to(std::string& out) const;
     bool to_bool() const;
+    bool is_true() const;
 
     Value operator+(const Value& other) const;
+    Value& operator+=(const Value& other);
+    Value& operator-=(const Value& other);
     Value operator-(const Value& other) const;
     Value operator*(const Value& other) const;
     Value operator/(const Value& other) const;
+    // Number division; division by zero gives nil.
+    static Value divide(double lhs, double rhs);
+    // Arithmetic on two numbers, checked by the caller; exact on integers.
+    static Value add_numbers(const Value& lhs, const Value& rhs);
+    static Value sub_numbers(const Value& lhs, const Value& rhs);
+    static Value mul_numbers(const Value& lhs, const Value& rhs);
+    static Value div_numbers(const Value& lhs, const Value& rhs);
+    static Value mod_numbers(const Value& lhs, const Value& rhs);
     Value operator%(const Value& other) const;
     Value pow(const Value& other) const;
     bool operator==(const Value& other) const;
@@ -64,16 +153,246 @@ public:
     Value operator>(const Value& other) const;
     Value operator>=(const Value& other) const;
 
-    Value logic_and(const Value& other) const;
-    Value logic_or(const Value& other) const;
+    // Unary minus of a number.
+    Value negate() const { return integer_ ? Value(-int_) : Value(-number_); }
     Value logic_not() const;
 
-    Value index(int idx) const;
+    int to_index() const;
+    // key is a number for strings and lists and any valid key for dictionaries.
+    Value index(const Value& key) const;
     Value slice(int start, int end) const;
 
-    Value call(const std::vector<Value>& args, ExecutionArgs& ex_args) const;
+    Value call(std::span<const Value> args, ExecutionArgs& ex_args) const;
 
 private:
     ValueType type_;
-    std::variant<double, std::string, bool, List, std::shared_ptr<FunctionObject>> data_;
-};
\ No newline at end of file
+    bool integer_ = false;      // a number stored in int_
+    union {
+        double number_;
+        int64_t int_;
+        bool boolean_;
+        HeapObject* object_;
+        const StdlibFunction* stdlib_;
+    };
+
+    bool is_heap() const {
+        return type_ == ValueType::string || type_ == ValueType::list || type_ == ValueType::dict ||
+               type_ == ValueType::function;
+    }
+};
+
+static_assert(sizeof(Value) == 16);
+
+
+// A string, or a rope: the pending concatenation left_ + right_ of two other strings.
+// Joining long strings builds a rope in O(1), and str() flattens it on the first read.
+// Flattening reuses the buffer of the leftmost piece when nothing else refers to it, so
+// `s = s + x` in a loop costs amortized O(|x|) per step even if s is read in between.
+class StringObject : public HeapObject {
+public:
+    // Shorter results are copied right away; a rope node costs more than the copy.
+    static constexpr size_t kMinRopeSize = 256;
+
+    explicit StringObject(std::string str) : str_(std::move(str)), size_(str_.size()) {}
+    StringObject(Ref<StringObject> left, Ref<StringObject> right);
+    ~StringObject() override;
+
+    static Ref<StringObject> concat(StringObject& left, StringObject& right);
+
+    size_t size() const { return size_; }
+    const std::string& str() const {
+        if (left_)
+            flatten();
+        return str_;
+    }
+    // Appends in place. Only for a string that no other value refers to.
+    void append(const std::string& tail);
+
+private:
+    mutable std::string str_;
+    mutable Ref<StringObject> left_;
+    mutable Ref<StringObject> right_;
+    size_t size_;
+
+    void flatten() const;
+};
+
+// A list in one of three forms, all read through size() and at():
+//  - numbers: a packed vector of doubles, kept while every element is a number;
+//  - values: a vector of Values, once anything else is stored;
+//  - range: the lazy integer progression start + i * step (i < size) produced by range(),
+//    until it is first mutated.
+// New lists start packed; items() switches any list to the generic form.
+class ListObject : public GcObject {
+public:
+    ListObject() = default;
+    explicit ListObject(std::vector<Value> items);
+    explicit ListObject(std::vector<double> numbers);
+    static Ref<ListObject> make_range(double start, double step, size_t size);
+
+    bool is_range() const { return storage_ == Storage::range; }
+    size_t size() const {
+        switch (storage_) {
+            case Storage::numbers: return numbers_.size();
+            case Storage::values: return items_.size();
+            case Storage::range: return range_size_;
+        }
+        return 0;
+    }
+    Value at(size_t i) const {
+        switch (storage_) {
+            case Storage::numbers: return Value::make_number(numbers_[i]);
+            case Storage::values: return items_[i];
+            case Storage::range: return Value::make_number(range_start_ + range_step_ * i);
+        }
+        return Value();
+    }
+    Ref<ListObject> slice(size_t start, size_t end) const;
+    Ref<ListObject> concat(const ListObject& other) const;
+
+    void push(const Value& value);
+    Value pop();
+    void insert(size_t i, const Value& value);
+    Value remove(size_t i);
+
+    // The elements as packed numbers, packing the list first if they all are numbers.
+    // The list can be modified in place through the span.
+    std::optional<std::span<double>> numbers();
+    std::vector<Value>& items();
+    // Replaces the elements, packing them if they all are numbers.
+    void assign(std::vector<Value> items);
+    bool operator==(const ListObject& other) const;
+
+    void trace(GcVisitor& visitor) const override;
+    void clear() override;
+
+private:
+    enum class Storage : uint8_t { numbers, values, range };
+
+    Storage storage_ = Storage::numbers;
+    std::vector<double> numbers_;
+    std::vector<Value> items_;
+    double range_start_ = 0;
+    double range_step_ = 0;
+    size_t range_size_ = 0;
+
+    void unpack();
+};
+
+// A hash table that keeps its entries in insertion order. entries_ holds the entries,
+// slots_ is an open-addressing index into it with linear probing and a power-of-two size.
+// Erasing leaves a tombstone (an entry with a nil key) that stays in the probe sequences
+// until the next rehash drops it. Keys are numbers other than NaN, strings and booleans.
+class DictObject : public GcObject {
+public:
+    static bool is_valid_key(const Value& key);
+
+    size_t size() const { return size_; }
+    // The value stored under key, or nullptr.
+    const Value* find(const Value& key) const;
+    // Throws if key is not a valid key.
+    void set(const Value& key, const Value& value);
+    // Removes key and returns its value, or nil if there was none.
+    Value erase(const Value& key);
+
+    template <typename F>
+    void for_each(F f) const {
+        for (const auto& entry : entries_) {
+            if (!entry.key_.is_nil())
+                f(entry.key_, entry.value_);
+        }
+    }
+    bool operator==(const DictObject& other) const;
+
+    void trace(GcVisitor& visitor) const override;
+    void clear() override;
+
+private:
+    struct Entry {
+        Value key_;
+        Value value_;
+        size_t hash_;
+    };
+
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> slots_;
+    size_t size_ = 0;
+
+    static size_t hash(const Value& key);
+    // The slot that refers to key, or the empty slot that ends its probe sequence.
+    size_t probe(const Value& key, size_t hash) const;
+    void rehash(size_t slot_count);
+};
+
+// body_ is owned by the program AST and prototype_ by the compiled program,
+// both of which outlive every function value created while running it.
+// Every call gets a fresh frame shaped by frame_ whose parent is the closure scope env_;
+// parameters occupy its first arity_ slots.
+struct FunctionObject : GcObject {
+    size_t arity_;
+    FrameLayout frame_;
+    ASTNode* body_;
+    Ref<Environment> env_;
+    const FunctionPrototype* prototype_ = nullptr;
+    const FunctionInfo* info_ = nullptr;     // for the profiler; owned like body_ and prototype_
+
+    FunctionObject(size_t arity, const FrameLayout& frame, ASTNode* body, Ref<Environment> env);
+    ~FunctionObject() override;
+
+    void trace(GcVisitor& visitor) const override;
+    void clear() override;
+};
+
+
+inline Value Value::add_numbers(const Value& lhs, const Value& rhs) {
+    if (lhs.integer_ && rhs.integer_)
+        return Value(lhs.int_ + rhs.int_);
+    return Value(lhs.as_number() + rhs.as_number());
+}
+
+inline Value Value::sub_numbers(const Value& lhs, const Value& rhs) {
+    if (lhs.integer_ && rhs.integer_)
+        return Value(lhs.int_ - rhs.int_);
+    return Value(lhs.as_number() - rhs.as_number());
+}
+
+// Larger factors may overflow int64 and are multiplied as doubles.
+inline Value Value::mul_numbers(const Value& lhs, const Value& rhs) {
+    constexpr int64_t kMaxFactor = INT32_MAX;
+    if (lhs.integer_ && rhs.integer_ && lhs.int_ >= -kMaxFactor && lhs.int_ <= kMaxFactor &&
+        rhs.int_ >= -kMaxFactor && rhs.int_ <= kMaxFactor)
+        return Value(lhs.int_ * rhs.int_);
+    return Value(lhs.as_number() * rhs.as_number());
+}
+
+inline Value Value::div_numbers(const Value& lhs, const Value& rhs) {
+    if (lhs.integer_ && rhs.integer_ && rhs.int_ != 0 && lhs.int_ % rhs.int_ == 0)
+        return Value(lhs.int_ / rhs.int_);
+    return divide(lhs.as_number(), rhs.as_number());
+}
+
+// Both forms truncate, so the sign of the result is the sign of lhs either way.
+inline Value Value::mod_numbers(const Value& lhs, const Value& rhs) {
+    if (lhs.integer_ && rhs.integer_ && rhs.int_ != 0)
+        return Value(lhs.int_ % rhs.int_);
+    return Value(std::fmod(lhs.as_number(), rhs.as_number()));
+}
+
+
+inline const std::string& Value::as_string() const {
+    return static_cast<StringObject*>(object_)->str();
+}
+
+inline ListObject& Value::as_list() const {
+    return *static_cast<ListObject*>(object_);
+}
+
+inline DictObject& Value::as_dict() const {
+    return *static_cast<DictObject*>(object_);
+}
+
+inline FunctionObject& Value::as_function() const {
+    return *static_cast<FunctionObject*>(object_);
+}
@@ -0,0 +1,440 @@
+#include "vm.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+VirtualMachine::VirtualMachine(Environment* global_env, FrameArena& arena, OutputBuffer& output, InputBuffer& input,
+                               size_t max_stack_bytes, uintptr_t stack_limit, Profiler* profiler)
+    : ex_args_(global_env, arena, output, input), stack_(256), sp_(0), max_stack_bytes_(max_stack_bytes) {
+    ex_args_.vm_ = this;
+    ex_args_.profiler_ = profiler;
+    ex_args_.stack_limit_ = stack_limit;
+}
+
+
+// Frames are still entered here only if a runtime error interrupted run().
+VirtualMachine::~VirtualMachine() {
+    while (frames_.size() > 1) {
+        ex_args_.arena_.leave(frames_.back().env_);
+        frames_.pop_back();
+    }
+}
+
+
+size_t VirtualMachine::frame_bytes(const FunctionPrototype& prototype) {
+    return sizeof(CallFrame) + Environment::allocation_size(prototype.frame_.size_);
+}
+
+
+void VirtualMachine::call(size_t arg_count) {
+    size_t base = sp_ - arg_count - 1;
+    const Value& callee = stack_[base];
+
+    if (callee.type() != ValueType::function) {
+        Value result = callee.call(std::span<const Value>(stack_.data() + base + 1, arg_count), ex_args_);
+        pop_to(base);
+        push() = std::move(result);
+        return;
+    }
+
+    FunctionObject* func = &callee.as_function();
+    const FunctionPrototype* prototype = func->prototype_;
+    if (!prototype)
+        throw std::runtime_error("call of a function without bytecode");
+    if (arg_count != func->arity_)
+        throw std::runtime_error("incorrect number of arguments");
+    size_t bytes = frame_bytes(*prototype);
+    if (frame_bytes_ + bytes + stack_.size() * sizeof(Value) > max_stack_bytes_)
+        throw std::runtime_error("stack overflow");
+    Environment* frame = ex_args_.arena_.enter(func->env_, func->frame_);
+    for (size_t i = 0; i < arg_count; ++i)
+        frame->declare(i, stack_[base + 1 + i]);
+    // The frame holds the closure's environment and the prototype outlives the function,
+    // so the callee may be released here.
+    pop_to(base);
+    frames_.push_back({prototype, 0, frame, base});
+    frame_bytes_ += bytes;
+    if (ex_args_.profiler_)
+        ex_args_.profiler_->enter(&prototype->info_);
+}
+
+
+bool VirtualMachine::tail_call(size_t arg_count) {
+    size_t base = sp_ - arg_count - 1;
+    const Value& callee = stack_[base];
+    if (frames_.size() == 1 || callee.type() != ValueType::function || !callee.as_function().prototype_)
+        return false;
+    // The callee and the arguments hold their own references, so the frame can go first;
+    // they then move down into its stack slots and the call proceeds as usual.
+    size_t frame_base = frames_.back().stack_base_;
+    pop_frame();
+    std::move(stack_.begin() + base, stack_.begin() + sp_, stack_.begin() + frame_base);
+    pop_to(frame_base + arg_count + 1);
+    call(arg_count);
+    return true;
+}
+
+
+// Pops a frame other than the program frame.
+void VirtualMachine::pop_frame() {
+    const CallFrame& frame = frames_.back();
+    ex_args_.arena_.leave(frame.env_);
+    frame_bytes_ -= frame_bytes(*frame.prototype_);
+    frames_.pop_back();
+    if (ex_args_.profiler_)
+        ex_args_.profiler_->leave();
+}
+
+
+template <typename Op>
+void VirtualMachine::binary(Op op) {
+    Value& lhs = top(1);
+    lhs = op(lhs, top());
+    pop();
+}
+
+
+template <typename Op>
+void VirtualMachine::specializing_binary(Instruction& ins, OpCode number_op, Op op) {
+    if (top(1).type() == ValueType::number && top().type() == ValueType::number)
+        ins = make_instruction(number_op);
+    binary(op);
+}
+
+
+template <typename Op>
+bool VirtualMachine::number_binary(Instruction& ins, OpCode generic_op, Op op) {
+    Value& lhs = top(1);
+    const Value& rhs = top();
+    if (lhs.type() != ValueType::number || rhs.type() != ValueType::number) {
+        ins = make_instruction(generic_op);
+        return false;
+    }
+    lhs = op(lhs, rhs);
+    pop();
+    return true;
+}
+
+
+Value VirtualMachine::run(const FunctionPrototype& program) {
+    frames_.push_back({&program, 0, ex_args_.env_, sp_});
+    return execute(1);
+}
+
+
+Value VirtualMachine::call_function(const Value& callee, std::span<const Value> args) {
+    // Each call from native code runs a nested dispatch loop on the native stack.
+    char here;
+    if (reinterpret_cast<uintptr_t>(&here) < ex_args_.stack_limit_)
+        throw std::runtime_error("stack overflow");
+    if (sp_ + args.size() + 1 > stack_.size()) {
+        // The callee and the arguments may live on the stack that is about to move.
+        Value saved_callee = callee;
+        std::vector<Value> saved_args(args.begin(), args.end());
+        stack_.resize(std::max(stack_.size() * 2, sp_ + args.size() + 1));
+        return call_function(saved_callee, saved_args);
+    }
+    push() = callee;
+    for (const Value& arg : args)
+        push() = arg;
+    size_t depth = frames_.size();
+    call(args.size());
+    if (frames_.size() == depth) {
+        Value result = std::move(top());
+        pop();
+        return result;
+    }
+    return execute(frames_.size());
+}
+
+
+Value VirtualMachine::execute(size_t entry_depth) {
+    return ex_args_.profiler_ ? dispatch<true>(entry_depth) : dispatch<false>(entry_depth);
+}
+
+
+template <bool kProfile>
+Value VirtualMachine::dispatch(size_t entry_depth) {
+    // The active frame is cached in locals and written back only around calls and returns.
+    const FunctionPrototype* prototype = nullptr;
+    Instruction* code = nullptr;
+    size_t ip = 0;
+    Environment* env = nullptr;
+    auto load_frame = [&]() {
+        const CallFrame& frame = frames_.back();
+        prototype = frame.prototype_;
+        code = prototype->code_.data();
+        ip = frame.ip_;
+        env = frame.env_;
+    };
+    load_frame();
+
+    while (true) {
+        if constexpr (kProfile)
+            ex_args_.profiler_->line(prototype->lines_[ip]);
+        Instruction ins = code[ip++];
+        uint32_t arg = get_operand(ins);
+
+        switch (get_opcode(ins)) {
+            case OpCode::constant:
+                push() = prototype->constants_[arg];
+                break;
+            case OpCode::nil:
+                push() = Value();
+                break;
+            case OpCode::pop:
+                pop();
+                break;
+            case OpCode::dup: {
+                Value& copy = push();
+                copy = top(1);
+                break;
+            }
+            case OpCode::get_var:
+                push() = env->get(prototype->bindings_[arg]);
+                break;
+            case OpCode::increment:
+            case OpCode::decrement: {
+                const Binding& binding = prototype->bindings_[arg];
+                Value* target = env->find(binding);
+                if (!target)
+                    throw std::runtime_error("undefined variable: " + binding.name_);
+                if (get_opcode(ins) == OpCode::increment)
+                    *target += top();
+                else
+                    *target -= top();
+                top() = *target;
+                break;
+            }
+            case OpCode::set_var:
+                env->assign_or_declare(prototype->bindings_[arg], top());
+                pop();
+                break;
+
+            case OpCode::add:
+                specializing_binary(code[ip - 1], OpCode::add_number, [](const Value& l, const Value& r) { return l + r; });
+                break;
+            case OpCode::sub:
+                specializing_binary(code[ip - 1], OpCode::sub_number, [](const Value& l, const Value& r) { return l - r; });
+                break;
+            case OpCode::mul:
+                specializing_binary(code[ip - 1], OpCode::mul_number, [](const Value& l, const Value& r) { return l * r; });
+                break;
+            case OpCode::div:
+                specializing_binary(code[ip - 1], OpCode::div_number, [](const Value& l, const Value& r) { return l / r; });
+                break;
+            case OpCode::mod:
+                specializing_binary(code[ip - 1], OpCode::mod_number, [](const Value& l, const Value& r) { return l % r; });
+                break;
+            case OpCode::pow: binary([](const Value& l, const Value& r) { return l.pow(r); }); break;
+            case OpCode::equal:
+                specializing_binary(code[ip - 1], OpCode::equal_number, [](const Value& l, const Value& r) { return l.equal(r); });
+                break;
+            case OpCode::not_equal:
+                specializing_binary(code[ip - 1], OpCode::not_equal_number, [](const Value& l, const Value& r) { return l.not_equal(r); });
+                break;
+            case OpCode::less:
+                specializing_binary(code[ip - 1], OpCode::less_number, [](const Value& l, const Value& r) { return l < r; });
+                break;
+            case OpCode::less_equal:
+                specializing_binary(code[ip - 1], OpCode::less_equal_number, [](const Value& l, const Value& r) { return l <= r; });
+                break;
+            case OpCode::greater:
+                specializing_binary(code[ip - 1], OpCode::greater_number, [](const Value& l, const Value& r) { return l > r; });
+                break;
+            case OpCode::greater_equal:
+                specializing_binary(code[ip - 1], OpCode::greater_equal_number, [](const Value& l, const Value& r) { return l >= r; });
+                break;
+
+            case OpCode::add_number:
+                if (!number_binary(code[ip - 1], OpCode::add, &Value::add_numbers))
+                    --ip;
+                break;
+            case OpCode::sub_number:
+                if (!number_binary(code[ip - 1], OpCode::sub, &Value::sub_numbers))
+                    --ip;
+                break;
+            case OpCode::mul_number:
+                if (!number_binary(code[ip - 1], OpCode::mul, &Value::mul_numbers))
+                    --ip;
+                break;
+            case OpCode::div_number:
+                if (!number_binary(code[ip - 1], OpCode::div, &Value::div_numbers))
+                    --ip;
+                break;
+            case OpCode::mod_number:
+                if (!number_binary(code[ip - 1], OpCode::mod, &Value::mod_numbers))
+                    --ip;
+                break;
+            case OpCode::equal_number:
+                if (!number_binary(code[ip - 1], OpCode::equal, [](const Value& l, const Value& r) { return Value(l.as_number() == r.as_number()); }))
+                    --ip;
+                break;
+            case OpCode::not_equal_number:
+                if (!number_binary(code[ip - 1], OpCode::not_equal, [](const Value& l, const Value& r) { return Value(l.as_number() != r.as_number()); }))
+                    --ip;
+                break;
+            case OpCode::less_number:
+                if (!number_binary(code[ip - 1], OpCode::less, [](const Value& l, const Value& r) { return Value(l.as_number() < r.as_number()); }))
+                    --ip;
+                break;
+            case OpCode::less_equal_number:
+                if (!number_binary(code[ip - 1], OpCode::less_equal, [](const Value& l, const Value& r) { return Value(l.as_number() <= r.as_number()); }))
+                    --ip;
+                break;
+            case OpCode::greater_number:
+                if (!number_binary(code[ip - 1], OpCode::greater, [](const Value& l, const Value& r) { return Value(l.as_number() > r.as_number()); }))
+                    --ip;
+                break;
+            case OpCode::greater_equal_number:
+                if (!number_binary(code[ip - 1], OpCode::greater_equal, [](const Value& l, const Value& r) { return Value(l.as_number() >= r.as_number()); }))
+                    --ip;
+                break;
+
+            case OpCode::negate: {
+                if (top().type() != ValueType::number)
+                    throw std::runtime_error("invalid type (unary '-')");
+                top() = top().negate();
+                break;
+            }
+            case OpCode::logic_not:
+                top() = top().logic_not();
+                break;
+            case OpCode::to_bool:
+                top() = Value(top().to_bool());
+                break;
+
+            case OpCode::jump:
+                ip = arg;
+                break;
+            case OpCode::jump_if_false:
+                if (!top().is_true())
+                    ip = arg;
+                pop();
+                break;
+            case OpCode::and_jump:
+            case OpCode::or_jump: {
+                bool value = top().to_bool();
+                if (value == (get_opcode(ins) == OpCode::or_jump)) {
+                    top() = Value(value);
+                    ip = arg;
+                } else {
+                    pop();
+                }
+                break;
+            }
+
+            case OpCode::make_list: {
+                auto list = make_ref<ListObject>(std::vector<Value>(std::make_move_iterator(stack_.begin() + (sp_ - arg)),
+                                                                    std::make_move_iterator(stack_.begin() + sp_)));
+                pop(arg);
+                push() = Value(list);
+                break;
+            }
+            case OpCode::make_dict: {
+                auto dict = make_ref<DictObject>();
+                for (size_t i = sp_ - 2 * arg; i < sp_; i += 2)
+                    dict->set(stack_[i], stack_[i + 1]);
+                pop(2 * arg);
+                push() = Value(dict);
+                break;
+            }
+            case OpCode::index: {
+                Value& target = top(1);
+                target = target.index(top());
+                pop();
+                break;
+            }
+            case OpCode::slice: {
+                int start = 0;
+                int end = std::numeric_limits<int>::max();
+                if (arg != 2) {
+                    end = top().to_index();
+                    pop();
+                }
+                if (arg == 0) {
+                    start = top().to_index();
+                    pop();
+                }
+                top() = top().slice(start, end);
+                break;
+            }
+            case OpCode::make_function: {
+                const auto& function = prototype->functions_[arg];
+                auto func = make_ref<FunctionObject>(function->arity_, function->frame_, nullptr, Ref<Environment>(env));
+                func->prototype_ = function.get();
+                func->info_ = &function->info_;
+                push() = Value(func);
+                break;
+            }
+            case OpCode::call:
+                frames_.back().ip_ = ip;
+                call(arg);
+                load_frame();
+                break;
+            case OpCode::inline_guard:
+                if (top().type() == ValueType::function && top().as_function().info_ &&
+                    top().as_function().info_->id_ == arg) {
+                    pop();
+                    ++ip;
+                }
+                break;
+            case OpCode::tail_call:
+                frames_.back().ip_ = ip;
+                if (!tail_call(arg))
+                    call(arg);
+                load_frame();
+                break;
+
+            case OpCode::print:
+                ex_args_.output_.print(top());
+                pop();
+                break;
+            case OpCode::println:
+                ex_args_.output_.println(top());
+                pop();
+                break;
+
+            case OpCode::for_prep:
+                if (top().type() != ValueType::list && top().type() != ValueType::lines)
+                    throw std::runtime_error("for loop expects a list");
+                push() = Value(int64_t(0));
+                break;
+            case OpCode::for_next: {
+                if (top(1).type() == ValueType::lines) {
+                    std::string line;
+                    if (!ex_args_.input_.read_line(line)) {
+                        ip = arg;
+                        break;
+                    }
+                    push() = Value(std::move(line));
+                    break;
+                }
+                size_t i = static_cast<size_t>(top().as_integer());
+                const auto& list = top(1).as_list();
+                if (i >= list.size()) {
+                    ip = arg;
+                    break;
+                }
+                top() = Value(static_cast<int64_t>(i + 1));
+                push() = list.at(i);
+                break;
+            }
+
+            case OpCode::return_value: {
+                Value result = std::move(top());
+                pop_to(frames_.back().stack_base_);
+                if (frames_.size() > 1)
+                    pop_frame();
+                else
+                    frames_.pop_back();
+                if (frames_.size() < entry_depth)
+                    return result;
+                push() = std::move(result);
+                load_frame();
+                break;
+            }
+        }
+    }
+}
\ No newline at end of file
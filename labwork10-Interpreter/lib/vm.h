@@ -0,0 +1,86 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <span>
+#include <iostream>
+#include "bytecode.h"
+#include "environment.h"
+#include "ast.h"
+
+
+// Dispatch-loop interpreter for the bytecode produced by Compiler.
+// Script-level calls push a CallFrame instead of recursing on the native stack, so recursion
+// depth is bounded only by max_stack_bytes, the memory that the frames, their activation
+// environments and the value stack may take together; a call past it fails with "stack overflow".
+// Only calls made from native code, such as a sort comparator, recurse on the native stack;
+// those fail the same way once it goes below stack_limit (see ExecutionArgs::stack_limit_).
+class VirtualMachine {
+public:
+    VirtualMachine(Environment* global_env, FrameArena& arena, OutputBuffer& output, InputBuffer& input,
+                   size_t max_stack_bytes, uintptr_t stack_limit = 0, Profiler* profiler = nullptr);
+    ~VirtualMachine();
+
+    Value run(const FunctionPrototype& program);
+    // Calls a function from native code, e.g. a stdlib callback, and runs it to completion.
+    // The stack may grow meanwhile, so values that live on it must not be used afterwards.
+    Value call_function(const Value& callee, std::span<const Value> args);
+
+private:
+    struct CallFrame {
+        const FunctionPrototype* prototype_;
+        size_t ip_;
+        Environment* env_;      // entered in the FrameArena, except for the program frame
+        size_t stack_base_;
+    };
+
+    ExecutionArgs ex_args_;
+    // Slots at and above sp_ are nil: popping releases the value, so the stack never keeps an object alive.
+    std::vector<Value> stack_;
+    size_t sp_;
+    std::vector<CallFrame> frames_;
+    size_t frame_bytes_ = 0;    // CallFrames and environments of the frames above the program frame
+    size_t max_stack_bytes_;
+
+    Value& push() {
+        if (sp_ == stack_.size())
+            stack_.resize(stack_.size() * 2);
+        return stack_[sp_++];
+    }
+
+    Value& top(size_t depth = 0) {
+        return stack_[sp_ - 1 - depth];
+    }
+
+    void pop(size_t count = 1) {
+        for (; count > 0; --count) {
+            Value& slot = stack_[--sp_];
+            if (slot.heap_object())
+                slot = Value();
+        }
+    }
+
+    void pop_to(size_t new_sp) {
+        pop(sp_ - new_sp);
+    }
+
+    static size_t frame_bytes(const FunctionPrototype& prototype);
+    void call(size_t arg_count);
+    // Replaces the current frame with a call of the function below the arguments.
+    // Returns false, doing nothing, if that is not a script function or the frame is the program's.
+    bool tail_call(size_t arg_count);
+    void pop_frame();
+    // Runs the dispatch loop until the frame at depth entry_depth returns.
+    Value execute(size_t entry_depth);
+    // The dispatch loop; only the instantiation with a profiler reports the line of every instruction.
+    template <bool kProfile>
+    Value dispatch(size_t entry_depth);
+    template <typename Op>
+    void binary(Op op);
+    // Runs a generic operator instruction and rewrites it into number_op once both operands are numbers.
+    template <typename Op>
+    void specializing_binary(Instruction& ins, OpCode number_op, Op op);
+    // Runs a *_number instruction. If an operand is not a number, rewrites it back into
+    // generic_op and returns false so that the caller re-executes it.
+    template <typename Op>
+    bool number_binary(Instruction& ins, OpCode generic_op, Op op);
+};
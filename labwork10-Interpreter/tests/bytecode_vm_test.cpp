@@ -0,0 +1,636 @@
+#include <filesystem>
+#include <fstream>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <lib/interpreter.h>
+#include <gtest/gtest.h>
+
+
+namespace {
+
+std::string run(const std::string& code, bool tree_walk, bool& ok, int optimization_level = 1) {
+    std::istringstream input(code);
+    std::ostringstream output;
+    InterpreterOptions options;
+    options.tree_walk_ = tree_walk;
+    options.optimization_level_ = optimization_level;
+    ok = interpret(input, output, options);
+    return output.str();
+}
+
+void ExpectSameResult(const std::string& code, const std::string& expected) {
+    for (int level : {0, 1}) {
+        bool vm_ok = false;
+        bool walker_ok = false;
+        std::string vm_output = run(code, false, vm_ok, level);
+        std::string walker_output = run(code, true, walker_ok, level);
+
+        ASSERT_TRUE(vm_ok) << vm_output;
+        ASSERT_TRUE(walker_ok) << walker_output;
+        ASSERT_EQ(vm_output, expected) << "-O" << level;
+        ASSERT_EQ(walker_output, expected) << "-O" << level;
+    }
+}
+
+// The number in the second column of the profiler report row labelled key.
+uint64_t ReportCount(const std::string& report, const std::string& key) {
+    std::istringstream rows(report);
+    std::string row;
+    while (std::getline(rows, row)) {
+        std::istringstream fields(row);
+        std::string label;
+        uint64_t count = 0;
+        if (fields >> label >> count && label == key)
+            return count;
+    }
+    return 0;
+}
+
+}  // namespace
+
+
+TEST(BytecodeVmTestSuite, ArithmeticAndVariables) {
+    std::string code = R"(
+        x = 2
+        y = x * 3 + 4 ^ 2 - 10 / 5
+        x += y
+        x %= 7
+        println(y)
+        print(x)
+    )";
+
+    ExpectSameResult(code, "20\n1");
+}
+
+
+TEST(BytecodeVmTestSuite, LoopsBreakContinue) {
+    std::string code = R"(
+        s = 0
+        for i in range(10)
+            if i == 7 then break end if
+            if i % 2 == 0 then continue end if
+            s += i
+        end for
+        j = 0
+        while j < 100
+            j += 1
+            if j > 4 then break end if
+        end while
+        println(s)
+        print(j)
+    )";
+
+    ExpectSameResult(code, "9\n5");
+}
+
+
+TEST(BytecodeVmTestSuite, ReturnFromLoop) {
+    std::string code = R"(
+        find = function(arr, x)
+            for i in range(len(arr))
+                if arr[i] == x then
+                    return i
+                end if
+                print(i)
+            end for
+            return -1
+        end function
+        println(find([5, 6, 7, 8], 7))
+        print(find([1], 3))
+    )";
+
+    ExpectSameResult(code, "012\n0-1");
+}
+
+
+TEST(BytecodeVmTestSuite, ImplicitFunctionResult) {
+    std::string code = R"(
+        last_assign = function() x = 5 end function
+        branch = function(c)
+            if c then "yes" else "no" end if
+        end function
+        loop = function() for i in range(3) i end for end function
+        empty = function() end function
+        println(last_assign())
+        println(branch(true))
+        println(branch(false))
+        println(loop())
+        print(empty())
+    )";
+
+    ExpectSameResult(code, "5\nyes\nno\nnil\nnil");
+}
+
+
+TEST(BytecodeVmTestSuite, FunctionsAndLists) {
+    std::string code = R"(
+        apply = function(f, l)
+            out = []
+            for x in l
+                push(out, f(x))
+            end for
+            return out
+        end function
+        sq = function(x) return x * x end function
+        l = apply(sq, [1, 2, 3, 4])
+        println(l)
+        println(l[1:3])
+        println(l[:2])
+        println(l[:])
+        println("ITMO"[-1])
+        print(not (1 < 2) or 3 >= 3 and "a" != "b")
+    )";
+
+    ExpectSameResult(code, "[1, 4, 9, 16]\n[4, 9]\n[1, 4]\n[1, 4, 9, 16]\nO\ntrue");
+}
+
+
+TEST(BytecodeVmTestSuite, FunctionDefinedInLoop) {
+    std::string code = R"(
+        for i in range(3)
+            f = function(x) return x + 1 end function
+            print(f(i))
+        end for
+    )";
+
+    ExpectSameResult(code, "123");
+}
+
+
+TEST(BytecodeVmTestSuite, RuntimeErrorsInBothModes) {
+    std::vector<std::string> programs = {
+        "x = 1 + \"a\"",
+        "print(undefined_name)",
+        "f = function(a) return a end function\nf()",
+        "x = -\"a\"",
+        "for i in 5 print(i) end for",
+        "x = 1\nwhile true x = x - \"a\" end while",
+        "if false then x = 1 end if\nprint(x)",
+    };
+
+    for (const auto& code : programs) {
+        for (int level : {0, 1}) {
+            bool ok = true;
+            run(code, false, ok, level);
+            ASSERT_FALSE(ok) << code;
+            run(code, true, ok, level);
+            ASSERT_FALSE(ok) << code;
+        }
+    }
+}
+
+
+TEST(BytecodeVmTestSuite, ResolvedScopes) {
+    std::string code = R"(
+        counter = 0
+        bump = function()
+            counter = counter + 1
+            local = counter * 10
+            return local
+        end function
+
+        bump()
+        println(bump())
+        println(counter)
+
+        shadow = function(counter)
+            counter = counter + 100
+            return counter
+        end function
+        println(shadow(1))
+        println(counter)
+
+        later = function()
+            return defined_after
+        end function
+        defined_after = "late"
+        println(later())
+    )";
+
+    ExpectSameResult(code, "20\n2\n101\n2\nlate\n");
+}
+
+
+TEST(BytecodeVmTestSuite, UndefinedVariableAfterResolve) {
+    std::string code = R"(
+        f = function()
+            return missing
+        end function
+        println(f())
+    )";
+
+    for (bool tree_walk : {false, true}) {
+        bool ok = true;
+        run(code, tree_walk, ok);
+        ASSERT_FALSE(ok);
+    }
+}
+
+
+TEST(BytecodeVmTestSuite, RecursionGetsOwnFrames) {
+    std::string code = R"(
+        fib = function(n)
+            if n < 2 then
+                return n
+            end if
+            return fib(n - 1) + fib(n - 2)
+        end function
+        println(fib(15))
+
+        fresh = function(first)
+            if first then
+                seen = "set"
+            end if
+            return seen
+        end function
+        seen = "global"
+        fresh(true)
+        println(fresh(false))
+
+        make_counter = function(start)
+            count = start
+            return function()
+                count += 1
+                return count
+            end function
+        end function
+        a = make_counter(10)
+        b = make_counter(100)
+        a()
+        println(a())
+        println(b())
+    )";
+
+    ExpectSameResult(code, "610\nset\n12\n101\n");
+}
+
+
+TEST(BytecodeVmTestSuite, OptimizedProgram) {
+    std::string code = R"(
+        println(2 * 3 + 4 ^ 2)
+        println(1 < 2 and not false)
+        println("ab" + "c" * 2)
+        println(-(1 + 2))
+
+        if 1 > 2 then
+            println("dead")
+        else
+            println("alive")
+        end if
+        while false
+            println("never")
+        end while
+
+        x = 0
+        s = ""
+        for i in range(5)
+            x += 2
+            x = x - 1
+            s += "a"
+        end for
+        println(x)
+        println(s)
+    )";
+
+    ExpectSameResult(code, "22\ntrue\nabcc\n-3\nalive\n5\naaaaa\n");
+}
+
+TEST(BytecodeVmTestSuite, OptimizerLeavesUnreachableCodeAlone) {
+    std::string code = R"(
+        if false then
+            x = "ab" * 1000000000
+        end if
+        while false
+            x = "ab" * 1000000000
+        end while
+        x = 1
+        if x > 5 then
+            y = "a" * 1e19
+        end if
+        println(len("ab" * 3000))
+        println("ok")
+    )";
+
+    ExpectSameResult(code, "6000\nok\n");
+}
+
+
+TEST(BytecodeVmTestSuite, ShortCircuitLogic) {
+    std::string code = R"(
+        calls = 0
+        touch = function(result)
+            calls += 1
+            return result
+        end function
+
+        println(false and touch(true))
+        println(true or touch(false))
+        println(calls)
+        println(true and touch(1))
+        println(false or touch(""))
+        println(calls)
+        println(nil or "text")
+    )";
+
+    ExpectSameResult(code, "false\ntrue\n0\ntrue\nfalse\n2\ntrue\n");
+}
+
+
+TEST(BytecodeVmTestSuite, SpecializedOperatorsSeeTypeChanges) {
+    std::string code = R"(
+        add = function(a, b)
+            return a + b
+        end function
+        less = function(a, b)
+            return a < b
+        end function
+
+        for i in range(3)
+            println(add(i, 1))
+        end for
+        println(add("a", "b"))
+        println(add(2, 3))
+        println(less(1, 2))
+        println(less("b", "a"))
+        println(less(2, 1))
+        println(add(1, 2) / 0)
+    )";
+
+    ExpectSameResult(code, "1\n2\n3\nab\n5\ntrue\nfalse\nfalse\nnil\n");
+}
+
+
+
+TEST(BytecodeVmTestSuite, SortCallbacks) {
+    std::string code = R"(
+        depth = function(n)
+            if n == 0 then
+                return 0
+            end if
+            return 1 + depth(n - 1)
+        end function
+        by_depth = function(a, b)
+            return depth(a * 100) > depth(b * 100)
+        end function
+
+        l = [5, 3, 8, 1]
+        println(sort(l, by_depth))
+        println(sort(l, function(x) return x % 4 end function))
+        println(sort([1, 2], function(a, b, c) return true end function))
+    )";
+
+    ExpectSameResult(code, "[8, 5, 3, 1]\n[8, 5, 1, 3]\nnil\n");
+}
+
+TEST(BytecodeVmTestSuite, BytecodeCacheFile) {
+    auto dir = std::filesystem::temp_directory_path() / "itmoscript_cache_test";
+    std::filesystem::create_directories(dir);
+    auto script = dir / "script.is";
+    auto cache = dir / "script.is.isc";
+    std::filesystem::remove(cache);
+
+    auto write = [](const std::filesystem::path& path, const std::string& text) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << text;
+    };
+    auto run_file = [&]() {
+        std::ostringstream output;
+        EXPECT_TRUE(interpret_file(script.string(), output)) << output.str();
+        return output.str();
+    };
+
+    write(script, "f = function(n) return n * 2 end function\nprintln(f(21))\nprintln(\"text\")\n");
+    ASSERT_EQ(run_file(), "42\ntext\n");
+    ASSERT_TRUE(std::filesystem::exists(cache));
+    ASSERT_EQ(run_file(), "42\ntext\n");
+
+    write(script, "println(1 + 1)\n");
+    ASSERT_EQ(run_file(), "2\n");
+    ASSERT_EQ(run_file(), "2\n");
+
+    write(cache, "ISC garbage");
+    ASSERT_EQ(run_file(), "2\n");
+
+    // A script with the cache extension keeps its source.
+    script = dir / "script.isc";
+    write(script, "println(\"hello\")\n");
+    ASSERT_EQ(run_file(), "hello\n");
+    ASSERT_EQ(run_file(), "hello\n");
+    ASSERT_TRUE(std::filesystem::exists(dir / "script.isc.isc"));
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(BytecodeVmTestSuite, DamagedBytecodeCacheIsIgnored) {
+    auto dir = std::filesystem::temp_directory_path() / "itmoscript_damaged_cache_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    auto script = dir / "script.is";
+    auto cache = dir / "script.is.isc";
+    {
+        std::ofstream file(script);
+        file << "f = function(l, n)\n"
+                "    s = 0\n"
+                "    for x in l\n"
+                "        if x > n then s += x end if\n"
+                "    end for\n"
+                "    return s\n"
+                "end function\n"
+                "println(f([1, 2, 3, 4], 2))\n"
+                "println(\"done\")\n";
+    }
+    auto run_file = [&]() {
+        std::ostringstream output;
+        interpret_file(script.string(), output);
+        return output.str();
+    };
+    std::string expected = "7\ndone\n";
+    ASSERT_EQ(run_file(), expected);
+    ASSERT_TRUE(std::filesystem::exists(cache));
+
+    std::string bytes;
+    {
+        std::ifstream file(cache, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), {});
+    }
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        std::string damaged = bytes;
+        damaged[i] ^= 0x5A;
+        {
+            std::ofstream file(cache, std::ios::binary | std::ios::trunc);
+            file << damaged;
+        }
+        ASSERT_EQ(run_file(), expected) << "byte " << i;
+    }
+
+    // The cache is written through a temporary file that does not outlive the run.
+    for (const auto& entry : std::filesystem::directory_iterator(dir))
+        EXPECT_NE(entry.path().extension(), ".tmp") << entry.path();
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(BytecodeVmTestSuite, ProfilerCountsCallsAndLines) {
+    std::string code = R"(inner = function(x)
+    return x * 2
+end function
+outer = function(n)
+    s = 0
+    for i in range(n)
+        s += inner(i)
+    end for
+    return s
+end function
+println(outer(10))
+println(outer(5))
+)";
+
+    for (bool tree_walk : {false, true}) {
+        for (int level : {0, 1}) {
+            Profiler profiler;
+            InterpreterOptions options;
+            options.tree_walk_ = tree_walk;
+            options.optimization_level_ = level;
+            options.profiler_ = &profiler;
+            std::istringstream input(code);
+            std::ostringstream output;
+            ASSERT_TRUE(interpret(input, output, options)) << output.str();
+            ASSERT_EQ(output.str(), "90\n20\n");
+
+            std::ostringstream report;
+            profiler.report(report);
+            EXPECT_EQ(ReportCount(report.str(), "outer:4"), 2) << report.str();
+            EXPECT_EQ(ReportCount(report.str(), "inner:1"), 15) << report.str();
+            EXPECT_EQ(ReportCount(report.str(), "2"), 15) << report.str();
+            EXPECT_EQ(ReportCount(report.str(), "6"), 17) << report.str();
+            EXPECT_EQ(ReportCount(report.str(), "7"), 15) << report.str();
+            EXPECT_EQ(ReportCount(report.str(), "11"), 1) << report.str();
+
+            std::ostringstream folded;
+            profiler.write_folded(folded);
+            std::istringstream stacks(folded.str());
+            std::string stack;
+            while (std::getline(stacks, stack))
+                EXPECT_TRUE(std::regex_match(stack, std::regex(R"(<main>(;(outer:4|inner:1))* \d+)"))) << stack;
+        }
+    }
+}
+
+TEST(BytecodeVmTestSuite, TailCallsAndStackOverflow) {
+    std::string tail_recursion = R"(
+        count = function(n, acc)
+            if n == 0 then
+                return acc
+            end if
+            return count(n - 1, acc + 1)
+        end function
+        down = function(n)
+            if n > 0 then
+                down(n - 1)
+            else
+                "done"
+            end if
+        end function
+        println(count(200000, 0))
+        println(down(200000))
+    )";
+    std::string endless_recursion = R"(
+        f = function(n)
+            return 1 + f(n + 1)
+        end function
+        println(f(0))
+    )";
+    // Recursion through a stdlib callback nests on the native stack in the VM as well.
+    std::string native_recursion = R"(
+        f = function(n)
+            l = sort([2, 1], function(a, b)
+                f(n + 1)
+                return a < b
+            end function)
+            return l
+        end function
+        println(f(0))
+    )";
+
+    for (int level : {0, 1}) {
+        InterpreterOptions options;
+        options.optimization_level_ = level;
+        options.max_stack_bytes_ = 1 << 20;
+        std::istringstream input(tail_recursion);
+        std::ostringstream output;
+        ASSERT_TRUE(interpret(input, output, options)) << output.str();
+        ASSERT_EQ(output.str(), "200000\ndone\n");
+    }
+
+    for (const std::string& code : {endless_recursion, native_recursion}) {
+        for (bool tree_walk : {false, true}) {
+            InterpreterOptions options;
+            options.tree_walk_ = tree_walk;
+            options.max_stack_bytes_ = 1 << 20;
+            std::istringstream input(code);
+            std::ostringstream output;
+            ASSERT_FALSE(interpret(input, output, options));
+            ASSERT_EQ(output.str(), "Error: stack overflow\n");
+        }
+    }
+
+    ExpectSameResult(R"(
+        depth = function(n)
+            if n == 0 then
+                return 0
+            end if
+            return 1 + depth(n - 1)
+        end function
+        println(depth(2000))
+    )", "2000\n");
+}
+
+TEST(BytecodeVmTestSuite, InlinedHelpers) {
+    std::string code = R"(
+        sq = function(x) return x * x end function
+        add = function(a, b) return a + b end function
+        s = 0
+        for i in range(5)
+            s += sq(i)
+        end for
+        println(s)
+        println(add(1, add(2, 3)))
+        loud = function(v)
+            print("arg ")
+            return v
+        end function
+        println(sq(loud(7)))
+        apply = function(sq, v) return sq(v) end function
+        println(apply(function(x) return x + 100 end function, 1))
+        twice = function(x) return x * 2 end function
+        twice = function(x) return x * 3 end function
+        println(twice(5))
+        early = function() return pre(1) end function
+        pre = function(x) return x - 1 end function
+        println(early())
+    )";
+    ExpectSameResult(code, "30\n6\narg 49\n101\n15\n0\n");
+}
+
+TEST(BytecodeVmTestSuite, InlinedArgumentsAreReleased) {
+    std::string code = R"(
+        first = function(l) return l[0] end function
+        before = heap_stats()["objects"]
+        x = first([1, 2, 3])
+        println(x)
+        println(heap_stats()["objects"] - before)
+    )";
+    ExpectSameResult(code, "1\n0\n");
+}
+
+TEST(BytecodeVmTestSuite, PoppedValuesAreReleased) {
+    std::string code = R"(
+        before = heap_stats()["objects"]
+        n = len([1, 2, 3])
+        println(n)
+        println(heap_stats()["objects"] - before)
+    )";
+    ExpectSameResult(code, "3\n0\n");
+}
@@ -236,4 +236,42 @@ TEST(FunctionTestSuite, FizzBuzzTest) {
 
     ASSERT_TRUE(interpret(input, output));
     ASSERT_EQ(output.str(), expected);
-}
\ No newline at end of file
+}
+
+
+TEST(FunctionTestSuite, ClosureCyclesAreCollected) {
+    std::string code = R"(
+        make = function()
+            helper = function() return helper end function
+            return helper
+        end function
+
+        keep = [1]
+        push(keep, keep)
+        for i in range(2000)
+            f = make()
+            l = [i]
+            push(l, l)
+            d = {}
+            set(d, "self", d)
+        end for
+
+        stats = heap_stats()
+        println(stats["peak_objects"] < 2000)
+        println(stats["collections"] > 0)
+        println(len(keep[1]))
+    )";
+
+    std::string expected = "true\ntrue\n2\n";
+
+    for (bool tree_walk : {false, true}) {
+        InterpreterOptions options;
+        options.tree_walk_ = tree_walk;
+        options.gc_threshold_ = 100;
+        std::istringstream input(code);
+        std::ostringstream output;
+
+        ASSERT_TRUE(interpret(input, output, options));
+        ASSERT_EQ(output.str(), expected);
+    }
+}
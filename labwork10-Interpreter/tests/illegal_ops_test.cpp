@@ -13,6 +13,7 @@ TEST(IllegalOperationsSuite, TypeMixing) {
         "123",
         "\"string\"",
         "[1, 2, 3]",
+        "{\"key\": 1}",
         "function() end function",
         "nil",
     };
@@ -49,3 +50,61 @@ TEST(IllegalOperationsSuite, ArgumentCountMismatch) {
     ASSERT_FALSE(interpret(input, output));
     ASSERT_FALSE(output.str().ends_with(kUnreachable));
 }
+
+
+TEST(IllegalOperationsSuite, DictionaryKeys) {
+    std::vector<std::string> statements = {
+        "d = {\"a\": 1}\nx = d[\"b\"]",
+        "d = {[1, 2]: 1}",
+        "d = {0 / 0: 1}",
+        "d = {}\nx = d[[]]",
+    };
+
+    for (const auto& statement : statements) {
+        std::stringstream input;
+        input << statement << "\n";
+        input << "print(239) // unreachable" << "\n";
+
+        std::ostringstream output;
+
+        ASSERT_FALSE(interpret(input, output));
+        ASSERT_FALSE(output.str().ends_with(kUnreachable));
+    }
+}
+
+
+TEST(IllegalOperationsSuite, RangeBounds) {
+    std::vector<std::pair<std::string, std::string>> statements = {
+        {"x = len(range(0, 1e300))", "range too large"},
+        {"x = range(0, 1e300, 0.5)", "range too large"},
+        {"x = range(-1e308, 1e308)", "range too large"},
+        {"x = range(0, 1e308 * 10)", "range bounds and step must be finite"},
+        {"x = range(0, 10, 1e308 * 10)", "range bounds and step must be finite"},
+    };
+
+    for (const auto& [statement, error] : statements) {
+        std::stringstream input;
+        input << statement << "\n";
+        input << "print(239) // unreachable" << "\n";
+
+        std::ostringstream output;
+
+        ASSERT_FALSE(interpret(input, output));
+        ASSERT_EQ(output.str(), "Error: " + error + "\n");
+    }
+}
+
+TEST(IllegalOperationsSuite, InputFunctionsTakeNoArguments) {
+    std::vector<std::string> functions = {"read", "read_all", "read_lines", "lines"};
+
+    for (const auto& function : functions) {
+        std::stringstream input;
+        input << "x = " << function << "(1)" << "\n";
+        input << "print(239) // unreachable" << "\n";
+
+        std::ostringstream output;
+
+        ASSERT_FALSE(interpret(input, output));
+        ASSERT_EQ(output.str(), "Error: " + function + ": wrong number of arguments\n");
+    }
+}
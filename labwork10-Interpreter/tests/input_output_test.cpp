@@ -36,4 +36,97 @@ TEST(InputOutputTests, ReadPrintlnTest) {
 
     ASSERT_TRUE(interpret(input, output));
     ASSERT_EQ(output.str(), expected);
-}
\ No newline at end of file
+}
+
+// Remembers what the script had written by the time it first read input.
+class SnoopingInput : public std::streambuf {
+    const std::ostringstream& output_;
+    std::string line_ = "ITMO\n";
+public:
+    std::string seen_;
+
+    explicit SnoopingInput(const std::ostringstream& output) : output_(output) {}
+
+protected:
+    int_type underflow() override {
+        if (gptr() == line_.data() + line_.size())
+            return traits_type::eof();
+        seen_ = output_.str();
+        setg(line_.data(), line_.data(), line_.data() + line_.size());
+        return traits_type::to_int_type(line_[0]);
+    }
+};
+
+
+TEST(InputOutputTests, BufferedOutputTest) {
+    std::string code = R"(
+        for i in range(20000)
+            println([i, i / 4, "x"])
+        end for
+        print("name: ")
+        println(read())
+        println(1 + nil)
+    )";
+
+    std::string expected;
+    for (int i = 0; i < 20000; ++i)
+        expected += "[" + std::to_string(i) + ", " + (i % 4 ? std::to_string(i / 4.0) : std::to_string(i / 4)) + ", x]\n";
+    expected += "name: ";
+
+    std::istringstream input(code);
+    std::ostringstream output;
+
+    SnoopingInput cin_input(output);
+    auto* old_buf = std::cin.rdbuf(&cin_input);
+
+    ASSERT_FALSE(interpret(input, output));
+    std::cin.rdbuf(old_buf);
+    ASSERT_EQ(cin_input.seen_, expected);
+    ASSERT_EQ(output.str(), expected + "ITMO\nError: invalid types (operator '+')\n");
+}
+
+
+TEST(InputOutputTests, BulkReadTest) {
+    std::string code = R"(
+        println(read())
+        n = 0
+        for line in lines()
+            if line == "stop" then
+                break
+            end if
+            n += len(line)
+        end for
+        println(n)
+        println(read_lines())
+        println(read())
+        println(read_all() == "")
+    )";
+
+    std::string expected =
+        "head\n"
+        "6\n"
+        "[x, , y]\n"
+        "nil\n"
+        "true\n";
+
+    for (bool tree_walk : {false, true}) {
+        InterpreterOptions options;
+        options.tree_walk_ = tree_walk;
+        std::istringstream script_input("head\na\nbb\n\nccc\nstop\nx\n\ny");
+        options.input_ = &script_input;
+        std::istringstream input(code);
+        std::ostringstream output;
+
+        ASSERT_TRUE(interpret(input, output, options));
+        ASSERT_EQ(output.str(), expected);
+    }
+
+    InterpreterOptions options;
+    std::string long_line(200000, 'a');
+    std::istringstream script_input(long_line + "\n" + long_line);
+    options.input_ = &script_input;
+    std::istringstream input("println(len(read()))\nprintln(len(read_all()))");
+    std::ostringstream output;
+    ASSERT_TRUE(interpret(input, output, options));
+    ASSERT_EQ(output.str(), "200000\n200000\n");
+}
@@ -180,4 +180,142 @@ TEST(ListTests, listSortTest) {
 
     ASSERT_TRUE(interpret(input, output));
     ASSERT_EQ(output.str(), expected);
-}
\ No newline at end of file
+}
+
+TEST(ListTests, SharedListTest) {
+    std::string code = R"(
+        a = [1, "two", [3]]
+        b = a
+        push(b, 4)
+        s = "str"
+        t = s
+        t += "ing"
+        c = a + [5]
+        push(c, 6)
+        print(a)
+        print(s)
+        print(t)
+        print(len(c))
+    )";
+
+    std::string expected = "[1, two, [3], 4]strstring6";
+
+    std::istringstream input(code);
+    std::ostringstream output;
+
+    ASSERT_TRUE(interpret(input, output));
+    ASSERT_EQ(output.str(), expected);
+}
+
+
+TEST(ListTests, RangeTest) {
+    std::string code = R"(
+        big = range(100000000)
+        print(len(big))
+        print(big[-1])
+        print(big[5:8])
+        print(range(10, 0, -3))
+        print(range(3) == [0, 1, 2])
+        print(range(0, 1, 0.25))
+
+        r = range(3)
+        total = 0
+        for i in r
+            total += i
+            if i == 0 then
+                push(r, 10)
+            end if
+        end for
+        print(total)
+        print(r)
+    )";
+
+    std::string expected = "10000000099999999[5, 6, 7][10, 7, 4, 1]true[0, 0.250000, 0.500000, 0.750000]13[0, 1, 2, 10]";
+
+    std::istringstream input(code);
+    std::ostringstream output;
+
+    ASSERT_TRUE(interpret(input, output));
+    ASSERT_EQ(output.str(), expected);
+}
+
+
+TEST(StrTests, LongConcatTest) {
+    std::string code = R"(
+        s = ""
+        r = ""
+        for i in range(2000)
+            s = s + "ab"
+            r = "cd" + r
+            if i == 1000 then
+                middle = s
+                println(len(middle))
+            end if
+        end for
+        s += "!"
+        println(len(s))
+        println(len(middle))
+        println(s[3999] + s[4000] + r[0])
+        println(s == middle + s[2002:len(s)])
+        println("ab" * 2.5)
+    )";
+
+    std::string expected = "2002\n4001\n2002\nb!c\ntrue\nababab\n";
+
+    std::istringstream input(code);
+    std::ostringstream output;
+
+    ASSERT_TRUE(interpret(input, output));
+    ASSERT_EQ(output.str(), expected);
+}
+
+
+TEST(DictTests, DictionaryTest) {
+    std::string code = R"(
+        d = {"a": 1, "b": [1, 2], 3: "three",}
+        println(d["a"])
+        println(d[3])
+        println(len(d))
+        set(d, "c", 5)
+        println(del(d, "a"))
+        println(has(d, "a"))
+        println(keys(d))
+        println(d)
+
+        counts = {}
+        for w in split("a b a c b a", " ")
+            set(counts, w, get(counts, w, 0) + 1)
+        end for
+        println(counts)
+
+        squares = {}
+        for i in range(1000)
+            set(squares, i, i * i)
+        end for
+        for i in range(0, 1000, 2)
+            del(squares, i)
+        end for
+        println(len(squares))
+        println(squares[999])
+        println(has(squares, 998))
+    )";
+
+    std::string expected =
+        "1\n"
+        "three\n"
+        "3\n"
+        "1\n"
+        "false\n"
+        "[b, 3, c]\n"
+        "{b: [1, 2], 3: three, c: 5}\n"
+        "{a: 3, b: 2, c: 1}\n"
+        "500\n"
+        "998001\n"
+        "false\n";
+
+    std::istringstream input(code);
+    std::ostringstream output;
+
+    ASSERT_TRUE(interpret(input, output));
+    ASSERT_EQ(output.str(), expected);
+}
@@ -101,4 +101,112 @@ TEST(StdlibTests, ListFunctions) {
 
     ASSERT_TRUE(interpret(input, output));
     ASSERT_EQ(output.str(), expected);
-}
\ No newline at end of file
+}
+
+TEST(StdlibTests, NumberListKernels) {
+    std::string code = R"(
+        xs = range(1, 11)
+        ys = [2, 2, 2, 2, 2, 2, 2, 2, 2, 2]
+        println(sum(xs))
+        println(min(xs))
+        println(max([3, -7, 12, 0.5]))
+        println(min(4, 2, 9))
+        println(dot(xs, ys))
+        println(add([1, 2, 3], [10, 20, 30]))
+        println(mul([1, 2, 3], 3))
+
+        mixed = [1, 2]
+        push(mixed, 3)
+        println(sum(mixed))
+        push(mixed, "four")
+        println(sum(mixed))
+        println(mixed)
+        pop(mixed)
+        println(sum(mixed))
+
+        println(sum([]))
+        println(max([]))
+        println(dot([1, 2], [1]))
+        println([1, 2] + range(3) == [1, 2, 0, 1, 2])
+    )";
+
+    std::string expected =
+        "55\n"
+        "1\n"
+        "12\n"
+        "2\n"
+        "110\n"
+        "[11, 22, 33]\n"
+        "[3, 6, 9]\n"
+        "6\n"
+        "nil\n"
+        "[1, 2, 3, four]\n"
+        "6\n"
+        "0\n"
+        "nil\n"
+        "nil\n"
+        "true\n";
+
+    std::istringstream input(code);
+    std::ostringstream output;
+
+    ASSERT_TRUE(interpret(input, output));
+    ASSERT_EQ(output.str(), expected);
+}
+
+
+TEST(StdlibTests, TypedSortTest) {
+    std::string code = R"(
+        l = [10, 9, 1, -2.5, 100]
+        sort(l)
+        println(l)
+        w = ["pear", "fig", "apple", "banana"]
+        println(sort(w))
+        println(sort(w, len))
+        m = [[2, 1], "b", 3, [1, 5], "a", 2]
+        println(sort(m))
+        println(sort(l, 1))
+    )";
+
+    std::string expected =
+        "[-2.500000, 1, 9, 10, 100]\n"
+        "[apple, banana, fig, pear]\n"
+        "[fig, pear, apple, banana]\n"
+        "[2, 3, a, b, [1, 5], [2, 1]]\n"
+        "nil\n";
+
+    std::istringstream input(code);
+    std::ostringstream output;
+
+    ASSERT_TRUE(interpret(input, output));
+    ASSERT_EQ(output.str(), expected);
+}
+
+
+TEST(StdlibTests, SortNumbersWithCallback) {
+    std::string code = R"(
+        l = [3, -1, 2.5, -4]
+        sort(l, abs)
+        println(l)
+        println(sum(l))
+        r = range(5)
+        sort(r, function(a, b) return a > b end function)
+        println(r)
+        println(dot(r, [1, 1, 1, 1, 1]))
+        push(r, "x")
+        println(sort(r, function(x) return 0 end function))
+    )";
+
+    std::string expected =
+        "[-1, 2.500000, 3, -4]\n"
+        "0.500000\n"
+        "[4, 3, 2, 1, 0]\n"
+        "10\n"
+        "[4, 3, 2, 1, 0, x]\n";
+
+    std::istringstream input(code);
+    std::ostringstream output;
+
+    ASSERT_TRUE(interpret(input, output));
+    ASSERT_EQ(output.str(), expected);
+}
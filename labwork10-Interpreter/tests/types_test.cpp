@@ -40,3 +40,73 @@ TEST(TypesTestSuite, ExpNotanionTest) {
     ASSERT_TRUE(interpret(input, output));
     ASSERT_EQ(output.str(), expected);
 }
+
+
+TEST(TypesTestSuite, LexerEdgesTest) {
+    std::string code = "x = 2.5e-1 // comment\r\n"
+                       "y = 1e400 > 1e300\r\n"
+                       "if x < 1 then\r\n"
+                       "    print(\"multi\nline\")\r\n"
+                       "end    if\r\n"
+                       "print(x * 4)\n"
+                       "print(y)";
+
+    std::string expected = "multi\nline1true";
+
+    std::istringstream input(code);
+    std::ostringstream output;
+
+    ASSERT_TRUE(interpret(input, output));
+    ASSERT_EQ(output.str(), expected);
+}
+
+
+TEST(TypesTestSuite, IntegerNumbersTest) {
+    std::string code = R"(
+        big = 9007199254740992
+        println(big + 1)
+        println(big * 2 - big)
+        println(3000000000 * 3)
+        println(7 / 2)
+        println(6 / 3)
+        println(-7 % 3)
+        println(7.5 % 2)
+        println(1 / 0)
+        println(2 ^ 10)
+        x = 1
+        x += 0.5
+        println(-x)
+        println(1 == 1.0)
+        d = {1: "a"}
+        println(d[1.0])
+        l = [1, 2.5, 3]
+        println(l[l[0]])
+        println(floor(7 / 2) * 2)
+    )";
+
+    std::string expected =
+        "9007199254740992\n"
+        "9007199254740992\n"
+        "9000000000\n"
+        "3.500000\n"
+        "2\n"
+        "-1\n"
+        "1.500000\n"
+        "nil\n"
+        "1024\n"
+        "-1.500000\n"
+        "true\n"
+        "a\n"
+        "2.500000\n"
+        "6\n";
+
+    for (bool tree_walk : {false, true}) {
+        InterpreterOptions options;
+        options.tree_walk_ = tree_walk;
+        std::istringstream input(code);
+        std::ostringstream output;
+
+        ASSERT_TRUE(interpret(input, output, options));
+        ASSERT_EQ(output.str(), expected);
+    }
+}